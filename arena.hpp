@@ -0,0 +1,145 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Bump allocator for objects that all die together. Memory is carved out of
+// large chunks and is only ever returned in bulk, either entirely by
+// `release` or back to an earlier `mark` by `rewind`, so objects placed in
+// an arena must be trivially destructible.
+class arena {
+    struct chunk {
+        chunk* prev;
+        std::size_t size;
+    };
+
+    static constexpr std::size_t header = (sizeof(chunk) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+
+    chunk* head;
+    // The most recently rewound chunk, kept to avoid going back to the heap
+    // when the arena is repeatedly rewound across a chunk boundary
+    chunk* spare;
+    char* curr;
+    char* end;
+    std::size_t initial_size;
+    std::size_t next_size;
+
+    std::size_t num_allocations;
+    std::size_t num_bytes;
+    std::size_t num_chunks;
+
+    void grow(std::size_t size, std::size_t align) {
+        std::size_t needed = header + size + align;
+        chunk* c;
+        if (spare != nullptr and spare->size >= needed) {
+            c = spare;
+            spare = nullptr;
+        } else {
+            while (next_size < needed)
+                next_size <<= 1;
+            c = static_cast<chunk*>(std::malloc(next_size));
+            if (c == nullptr)
+                throw std::bad_alloc();
+            c->size = next_size;
+            num_chunks++;
+            next_size <<= 1;
+        }
+        c->prev = head;
+        head = c;
+        curr = reinterpret_cast<char*>(c) + header;
+        end = reinterpret_cast<char*>(c) + c->size;
+    }
+
+public:
+    arena(std::size_t initial_size = 1 << 16)
+        : head(nullptr), spare(nullptr), curr(nullptr), end(nullptr),
+          initial_size(initial_size), next_size(initial_size),
+          num_allocations(0), num_bytes(0), num_chunks(0) {}
+
+    arena(const arena&) = delete;
+    arena& operator=(const arena&) = delete;
+
+    ~arena() {
+        release();
+    }
+
+    void* allocate(std::size_t size, std::size_t align = alignof(std::max_align_t)) {
+        std::size_t pad = (align - reinterpret_cast<std::size_t>(curr) % align) % align;
+        if (curr == nullptr or size + pad > static_cast<std::size_t>(end - curr)) {
+            grow(size, align);
+            pad = (align - reinterpret_cast<std::size_t>(curr) % align) % align;
+        }
+        void* res = curr + pad;
+        curr += pad + size;
+        num_allocations++;
+        num_bytes += size;
+        return res;
+    }
+
+    // A point in the arena's allocation history that it can be rewound to
+    struct position {
+        chunk* head;
+        char* curr;
+        char* end;
+        std::size_t allocations;
+        std::size_t bytes;
+    };
+
+    position mark() const {
+        return {head, curr, end, num_allocations, num_bytes};
+    }
+
+    // Frees everything allocated since `pos` was marked. Marks must be
+    // rewound in the reverse order they were taken.
+    void rewind(const position& pos) {
+        while (head != pos.head) {
+            chunk* prev = head->prev;
+            if (spare == nullptr or spare->size < head->size) {
+                std::free(spare);
+                spare = head;
+            } else {
+                std::free(head);
+            }
+            head = prev;
+        }
+        curr = pos.curr;
+        end = pos.end;
+        num_allocations = pos.allocations;
+        num_bytes = pos.bytes;
+    }
+
+    // Frees every chunk at once. Anything allocated from the arena is
+    // invalid afterwards.
+    void release() {
+        while (head != nullptr) {
+            chunk* prev = head->prev;
+            std::free(head);
+            head = prev;
+        }
+        std::free(spare);
+        spare = nullptr;
+        curr = end = nullptr;
+        next_size = initial_size;
+        num_allocations = num_bytes = num_chunks = 0;
+    }
+
+    // Number of objects handed out since the last release
+    std::size_t allocations() const {
+        return num_allocations;
+    }
+
+    // Number of bytes handed out since the last release
+    std::size_t bytes() const {
+        return num_bytes;
+    }
+
+    // Number of general-purpose heap allocations made since the last
+    // release, including any for chunks that have since been rewound
+    std::size_t chunks() const {
+        return num_chunks;
+    }
+};
+
+#endif
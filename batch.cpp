@@ -0,0 +1,326 @@
+#ifndef BATCH_BATCH_CPP
+#define BATCH_BATCH_CPP
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "rs-system.cpp"
+#include "timer.hpp"
+
+// Answers many independent queries in one process, so that startup is paid
+// once rather than per query. Queries are read one per line, each a
+// formula, and are decided at the same time by a set of workers. Each
+// answer is written on a line of its own, in the order the queries came
+// in: `tautology`, `not tautology`, `unknown` when a query reached its
+// limits, or `error: ` and what was wrong with the query.
+namespace Batch {
+    struct Options {
+        // Number of queries decided at the same time, or 0 for one per
+        // hardware thread
+        unsigned workers = 0;
+        // Settings for deciding each query. Each query is decided on a
+        // single thread, and leaves are never printed.
+        RSSystem::Options check;
+        // Limits on each query, counted from when a worker takes it up: its
+        // time, or 0 for no limit, and its work and leaves as in
+        // `RSSystem::Limits`
+        std::chrono::steady_clock::duration timeout{0};
+        std::uint64_t max_steps = 0;
+        std::size_t max_leaves = 0;
+    };
+
+    struct Statistics {
+        std::size_t queries = 0;
+        double seconds = 0;
+
+        double queries_per_second() const {
+            return seconds > 0 ? queries / seconds : 0;
+        }
+    };
+
+    namespace {
+        // Reads lines from a file descriptor, a block at a time
+        class LineReader {
+            int fd;
+            std::string buffer;
+            std::size_t start = 0;
+            bool at_end = false;
+
+        public:
+            LineReader(int fd) : fd(fd) {}
+
+            // Reads the next line, without its line break, or returns false
+            // at the end of the input
+            bool next(std::string& line) {
+                while (true) {
+                    std::size_t end = buffer.find('\n', start);
+                    if (end != std::string::npos) {
+                        line.assign(buffer, start, end - start);
+                        start = end + 1;
+                        return true;
+                    }
+                    if (at_end) {
+                        if (start == buffer.size())
+                            return false;
+                        line.assign(buffer, start);
+                        start = buffer.size();
+                        return true;
+                    }
+                    buffer.erase(0, start);
+                    start = 0;
+                    std::size_t size = buffer.size();
+                    buffer.resize(size + (1 << 16));
+                    ssize_t count;
+                    do {
+                        count = read(fd, buffer.data() + size, 1 << 16);
+                    } while (count < 0 and errno == EINTR);
+                    buffer.resize(size + std::max<ssize_t>(count, 0));
+                    if (count < 0)
+                        throw std::runtime_error(std::string("Cannot read queries: ") + std::strerror(errno));
+                    at_end = count == 0;
+                }
+            }
+        };
+
+        bool write_all(int fd, std::string_view text) {
+            while (!text.empty()) {
+                ssize_t count = write(fd, text.data(), text.size());
+                if (count < 0 and errno == EINTR)
+                    continue;
+                if (count <= 0)
+                    return false;
+                text.remove_prefix(count);
+            }
+            return true;
+        }
+
+        // Hands queries to the workers and writes their answers in order.
+        // Once `max_pending` queries have been read but not yet answered
+        // and written, reading waits, so that a long stream of queries is
+        // never held in memory at once.
+        class Server {
+            const Options& options;
+            int out;
+            std::size_t max_pending;
+
+            std::mutex lock;
+            std::condition_variable queries_ready;
+            std::condition_variable room;
+            // Queries not yet taken by a worker, with their numbers
+            std::deque<std::pair<std::size_t, std::string>> queries;
+            // Answers to the queries numbered from `written` on, as far as
+            // they are known
+            std::deque<std::optional<std::string>> answers;
+            std::size_t submitted = 0;
+            std::size_t written = 0;
+            bool closed = false;
+            // Whether writing an answer failed, such as when a client went
+            // away, after which answers are dropped
+            bool failed = false;
+
+            // Held while answers are written, so that they come out in order
+            std::mutex write_lock;
+
+            std::string answer(RSSystem::Session& session, const std::string& query) {
+                RSSystem::Limits limits;
+                if (options.timeout.count() > 0)
+                    limits.deadline = std::chrono::steady_clock::now() + options.timeout;
+                limits.max_steps = options.max_steps;
+                limits.max_leaves = options.max_leaves;
+                try {
+                    return RSSystem::to_str(RSSystem::check_lines(session, query, options.check, limits).verdict);
+                } catch (const std::exception& e) {
+                    return std::string("error: ") + e.what();
+                }
+            }
+
+            // Writes out every answer that is next in line
+            void drain() {
+                std::lock_guard<std::mutex> writing(write_lock);
+                std::string text;
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    while (!answers.empty() and answers.front().has_value()) {
+                        text += *answers.front();
+                        text += '\n';
+                        answers.pop_front();
+                        written++;
+                    }
+                    if (failed or text.empty())
+                        return;
+                }
+                room.notify_one();
+                if (!write_all(out, text)) {
+                    std::lock_guard<std::mutex> guard(lock);
+                    failed = true;
+                    room.notify_one();
+                }
+            }
+
+        public:
+            Server(const Options& options, int out, unsigned workers)
+                : options(options), out(out), max_pending(256 * workers) {}
+
+            // Queues a query, or returns false once answers can no longer
+            // be written
+            bool submit(std::string query) {
+                std::unique_lock<std::mutex> guard(lock);
+                room.wait(guard, [&]() { return failed or submitted - written < max_pending; });
+                if (failed)
+                    return false;
+                queries.emplace_back(submitted++, std::move(query));
+                answers.emplace_back();
+                queries_ready.notify_one();
+                return true;
+            }
+
+            // Lets the workers finish once the queued queries are answered
+            void close() {
+                std::lock_guard<std::mutex> guard(lock);
+                closed = true;
+                queries_ready.notify_all();
+            }
+
+            void work() {
+                // The session is reset by each query, and only its memory is
+                // carried over to the next
+                RSSystem::Session session;
+                while (true) {
+                    std::unique_lock<std::mutex> guard(lock);
+                    queries_ready.wait(guard, [&]() { return closed or !queries.empty(); });
+                    if (queries.empty())
+                        return;
+                    auto [number, query] = std::move(queries.front());
+                    queries.pop_front();
+                    guard.unlock();
+
+                    std::string result = answer(session, query);
+                    guard.lock();
+                    answers[number - written] = std::move(result);
+                    guard.unlock();
+                    drain();
+                }
+            }
+
+            std::size_t num_submitted() const {
+                return submitted;
+            }
+        };
+    }
+
+    // Answers the queries read from `in` on `out`, until the end of the
+    // input
+    Statistics serve(int in, int out, const Options& options) {
+        timer t;
+        unsigned workers = options.workers != 0 ? options.workers : std::max(1u, std::thread::hardware_concurrency());
+        Options settings = options;
+        settings.check.threads = 1;
+        settings.check.print_leaves = false;
+
+        Server server(settings, out, workers);
+        std::vector<std::thread> threads;
+        for (unsigned i = 0; i < workers; i++)
+            threads.emplace_back([&]() { server.work(); });
+
+        LineReader reader(in);
+        std::string line;
+        try {
+            while (reader.next(line) and server.submit(std::move(line)))
+                line = std::string();
+        } catch (...) {
+            server.close();
+            for (auto& thread : threads)
+                thread.join();
+            throw;
+        }
+        server.close();
+        for (auto& thread : threads)
+            thread.join();
+
+        Statistics stats;
+        stats.queries = server.num_submitted();
+        stats.seconds = t.get_time();
+        return stats;
+    }
+
+    // Clients that have not taken an answer for this long are dropped
+    constexpr int client_write_timeout_seconds = 30;
+
+    // Listens on a Unix socket at `path`, and answers the queries of each
+    // client that connects until it closes its end. Each client is served
+    // on a thread of its own by a set of workers of its own, so a slow or
+    // stuck client only holds up its own queries. Clients should read
+    // answers while still sending queries, and one that stops reading
+    // them is dropped after `client_write_timeout_seconds`. Throughput is
+    // logged after each client. Never returns, unless the socket cannot be
+    // set up.
+    void serve_socket(const char* path, const Options& options, std::ostream& log) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (std::strlen(path) >= sizeof(address.sun_path))
+            throw std::runtime_error(std::string("Socket path is too long: ") + path);
+        std::strcpy(address.sun_path, path);
+
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0)
+            throw std::runtime_error(std::string("Cannot create socket: ") + std::strerror(errno));
+        unlink(path);
+        if (bind(listener, (sockaddr*)&address, sizeof(address)) < 0 or listen(listener, 16) < 0) {
+            close(listener);
+            throw std::runtime_error(std::string("Cannot listen on ") + path + ": " + std::strerror(errno));
+        }
+        // A client that leaves early must not take the server with it
+        std::signal(SIGPIPE, SIG_IGN);
+
+        timeval write_timeout{};
+        write_timeout.tv_sec = client_write_timeout_seconds;
+        // Shared by the clients' threads, which outlive no call since this
+        // one never returns
+        std::mutex log_lock;
+        while (true) {
+            int client = accept(listener, nullptr, nullptr);
+            if (client < 0)
+                continue;
+            setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &write_timeout, sizeof(write_timeout));
+            try {
+                std::thread([client, &options, &log, &log_lock]() {
+                    try {
+                        Statistics stats = serve(client, client, options);
+                        std::lock_guard<std::mutex> guard(log_lock);
+                        log << "Answered " << stats.queries << " queries in " << stats.seconds << " s ("
+                            << stats.queries_per_second() << " queries/s)" << std::endl;
+                    } catch (const std::exception& e) {
+                        std::lock_guard<std::mutex> guard(log_lock);
+                        log << e.what() << std::endl;
+                    }
+                    close(client);
+                }).detach();
+            } catch (const std::exception& e) {
+                std::lock_guard<std::mutex> guard(log_lock);
+                log << e.what() << std::endl;
+                close(client);
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,463 @@
+#ifndef BDD_BDD_CPP
+#define BDD_BDD_CPP
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+#include "parser.cpp"
+
+// Reduced ordered binary decision diagrams. Every boolean function over a
+// fixed variable order has exactly one reduced diagram, and the manager
+// shares equal subdiagrams, so two formulas are equivalent exactly when
+// they are built to the same node, and a formula is a tautology exactly
+// when it is built to the `one` terminal.
+namespace BDD {
+    using Parser::Formula;
+    using Parser::UnaryFormula;
+    using Parser::BinaryFormula;
+    using Parser::NaryFormula;
+    using Parser::FormulaType;
+    using Parser::FormulaFactory;
+
+    using Tokenizer::Token;
+
+    using Node = unsigned;
+
+    constexpr Node zero = 0;
+    constexpr Node one = 1;
+
+    struct Statistics {
+        std::size_t nodes = 0;
+        std::size_t bytes = 0;
+        std::uint64_t cache_lookups = 0;
+        std::uint64_t cache_hits = 0;
+    };
+
+    class Manager {
+        static constexpr Node none = static_cast<Node>(-1);
+
+        // Node `n` tests variable level `levels[n]`, and continues to
+        // `lows[n]` when it is false and to `highs[n]` when it is true. The
+        // terminals sit below every variable.
+        std::vector<unsigned> levels;
+        std::vector<Node> lows;
+        std::vector<Node> highs;
+
+        // Open addressing table of every non-terminal node, sized to a
+        // power of two
+        std::vector<Node> unique;
+
+        // Lossy cache of ITE results, indexed by a hash of the operands
+        struct CacheEntry {
+            Node f, g, h;
+            Node result;
+        };
+        std::vector<CacheEntry> cache;
+
+        std::uint64_t cache_lookups = 0;
+        std::uint64_t cache_hits = 0;
+
+        // The variable at each level, and the level of each variable id
+        std::vector<Token> order;
+        std::vector<unsigned> level_of;
+
+        // Called with the number of nodes every so often while building,
+        // to give up on diagrams that grow too large or take too long
+        const std::function<bool(std::uint64_t)>* stop = nullptr;
+        struct Stopped {};
+
+        static std::size_t hash(std::size_t a, std::size_t b, std::size_t c) {
+            std::size_t h = a * 0x9e3779b97f4a7c15ull;
+            h ^= b + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+            h ^= c + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+            return h ^ (h >> 29);
+        }
+
+        void grow_unique() {
+            std::vector<Node> old(unique.size() << 1, none);
+            old.swap(unique);
+            std::size_t mask = unique.size() - 1;
+            for (Node node : old) {
+                if (node == none)
+                    continue;
+                std::size_t slot = hash(levels[node], lows[node], highs[node]) & mask;
+                while (unique[slot] != none)
+                    slot = (slot + 1) & mask;
+                unique[slot] = node;
+            }
+        }
+
+        // The node testing `level` with the given branches, which is just
+        // the branch when both are the same
+        Node make(unsigned level, Node low, Node high) {
+            if (low == high)
+                return low;
+            std::size_t mask = unique.size() - 1;
+            std::size_t slot = hash(level, low, high) & mask;
+            while (unique[slot] != none) {
+                Node node = unique[slot];
+                if (levels[node] == level and lows[node] == low and highs[node] == high)
+                    return node;
+                slot = (slot + 1) & mask;
+            }
+            Node node = levels.size();
+            if (stop != nullptr and node % 1024 == 0 and (*stop)(node))
+                throw Stopped{};
+            levels.push_back(level);
+            lows.push_back(low);
+            highs.push_back(high);
+            unique[slot] = node;
+            if (2 * (levels.size() - 2) > unique.size())
+                grow_unique();
+            return node;
+        }
+
+        unsigned top_level(Node f) const {
+            return levels[f];
+        }
+
+        // The diagram of `f` with the variable at `level` fixed to `value`,
+        // for a level at or above the top of `f`
+        Node restrict_top(Node f, unsigned level, bool value) const {
+            if (levels[f] != level)
+                return f;
+            return value ? highs[f] : lows[f];
+        }
+
+        // The result of `ite(f, g, h)` when it is known without splitting
+        // on a variable: a terminal case, or a hit in the cache
+        bool known(Node f, Node g, Node h, Node& result) {
+            if (f == one or g == h) {
+                result = g;
+                return true;
+            }
+            if (f == zero) {
+                result = h;
+                return true;
+            }
+            if (g == one and h == zero) {
+                result = f;
+                return true;
+            }
+            cache_lookups++;
+            const CacheEntry& entry = cache[hash(f, g, h) & (cache.size() - 1)];
+            if (entry.f == f and entry.g == g and entry.h == h) {
+                cache_hits++;
+                result = entry.result;
+                return true;
+            }
+            return false;
+        }
+
+        // A call of `ite` waiting for its branches: `low` until it is known
+        struct Call {
+            Node f, g, h;
+            unsigned level;
+            Node low;
+        };
+        // Kept between calls so that its memory is reused
+        std::vector<Call> calls;
+
+    public:
+        // `order` lists the variables from the top of the diagrams down
+        explicit Manager(const std::vector<Token>& order, std::size_t cache_size = 1 << 18)
+            : unique(1 << 10, none), cache(cache_size, {none, none, none, none}), order(order) {
+            unsigned terminal = order.size();
+            levels = {terminal, terminal};
+            lows = {zero, one};
+            highs = {zero, one};
+            unsigned variables = 0;
+            for (auto token : order)
+                variables = std::max<unsigned>(variables, token.id() + 1);
+            level_of.assign(variables, terminal);
+            for (unsigned level = 0; level < order.size(); level++)
+                level_of[order[level].id()] = level;
+        }
+
+        // The diagram of a single variable
+        Node variable(Token token) {
+            return make(level_of[token.id()], zero, one);
+        }
+
+        // If-then-else: `(f ^ g) v (~f ^ h)`. Every other operation is
+        // built on top of it. Splits on the top variable of the operands,
+        // the low branch first, with an explicit stack of calls, so that
+        // diagrams over any number of variables cannot overflow the call
+        // stack.
+        Node ite(Node f, Node g, Node h) {
+            Node result;
+            if (known(f, g, h, result))
+                return result;
+            calls.clear();
+            calls.push_back({f, g, h, std::min(top_level(f), std::min(top_level(g), top_level(h))), none});
+            while (true) {
+                Call& call = calls.back();
+                bool high = call.low != none;
+                Node cf = restrict_top(call.f, call.level, high);
+                Node cg = restrict_top(call.g, call.level, high);
+                Node ch = restrict_top(call.h, call.level, high);
+                if (!known(cf, cg, ch, result)) {
+                    calls.push_back({cf, cg, ch, std::min(top_level(cf), std::min(top_level(cg), top_level(ch))), none});
+                    continue;
+                }
+                // Hand the result up to every call it completes
+                while (true) {
+                    Call& done = calls.back();
+                    if (done.low == none) {
+                        done.low = result;
+                        break;
+                    }
+                    result = make(done.level, done.low, result);
+                    cache[hash(done.f, done.g, done.h) & (cache.size() - 1)] = {done.f, done.g, done.h, result};
+                    calls.pop_back();
+                    if (calls.empty())
+                        return result;
+                }
+            }
+        }
+
+        Node negate(Node f) {
+            return ite(f, zero, one);
+        }
+
+        Node conjoin(Node f, Node g) {
+            return ite(f, g, zero);
+        }
+
+        Node disjoin(Node f, Node g) {
+            return ite(f, one, g);
+        }
+
+        Node implies(Node f, Node g) {
+            return ite(f, g, one);
+        }
+
+        // Joins `operands` by `op`, an AND or OR, in pairs and then pairs
+        // of pairs. Operands next to each other in a formula tend to share
+        // variables, and each diagram is only taken apart about log n
+        // times, where joining one operand at a time would go through
+        // the growing result once per operand. Leaves `operands` changed.
+        Node join(Token op, std::vector<Node>& operands) {
+            if (operands.empty())
+                return op == Token::And ? one : zero;
+            while (operands.size() > 1) {
+                std::size_t kept = 0;
+                for (std::size_t i = 0; i + 1 < operands.size(); i += 2)
+                    operands[kept++] = op == Token::And ? conjoin(operands[i], operands[i + 1]) : disjoin(operands[i], operands[i + 1]);
+                if (operands.size() % 2 == 1)
+                    operands[kept++] = operands.back();
+                operands.resize(kept);
+            }
+            return operands[0];
+        }
+
+        // Appends the operands of the run of ANDs or ORs that `top` is the
+        // top of: the operands of every binary or n-ary formula with the
+        // same connective below it that is not built yet. Each of those is
+        // walked once, marked in `in_run` while the run is gathered.
+        static void gather_run(Formula* top, const std::vector<Node>& built, std::vector<bool>& in_run, std::vector<Formula*>& operands) {
+            std::vector<Formula*> stack{top};
+            std::vector<Formula*> walked;
+            while (!stack.empty()) {
+                Formula* formula = stack.back();
+                stack.pop_back();
+                bool same = (formula->type == FormulaType::Binary or formula->type == FormulaType::Nary) and formula->token == top->token;
+                if (!same or (formula != top and built[formula->id] != none)) {
+                    operands.push_back(formula);
+                    continue;
+                }
+                if (in_run[formula->id])
+                    continue;
+                in_run[formula->id] = true;
+                walked.push_back(formula);
+                if (formula->type == FormulaType::Binary) {
+                    stack.push_back(((BinaryFormula*)formula)->right);
+                    stack.push_back(((BinaryFormula*)formula)->left);
+                } else {
+                    auto op = (NaryFormula*)formula;
+                    for (unsigned i = op->arity; i-- > 0;)
+                        stack.push_back(op->operands[i]);
+                }
+            }
+            for (auto formula : walked)
+                in_run[formula->id] = false;
+        }
+
+        // Builds the diagram of every formula reachable from `formulas`,
+        // joined by `v`, or gives up with no diagram once `stop` returns
+        // true. The manager's nodes stay valid either way.
+        std::optional<Node> build(const FormulaFactory& factory, const std::vector<Formula*>& formulas, const std::function<bool(std::uint64_t)>& stop) {
+            this->stop = stop ? &stop : nullptr;
+            try {
+                Node root = build(factory, formulas);
+                this->stop = nullptr;
+                return root;
+            } catch (const Stopped&) {
+                this->stop = nullptr;
+                return std::nullopt;
+            }
+        }
+
+        // Builds the diagram of every formula reachable from `formulas`,
+        // joined by `v`. Shared subformulas are only built once.
+        Node build(const FormulaFactory& factory, const std::vector<Formula*>& formulas) {
+            std::vector<Node> built(factory.size(), none);
+            std::vector<std::pair<Formula*, bool>> stack;
+            std::vector<Node> operands;
+            std::vector<Node> roots;
+            // The operands of the runs being joined, innermost last
+            std::vector<std::vector<Formula*>> runs;
+            std::vector<bool> in_run(factory.size(), false);
+            for (auto root : formulas) {
+                stack.push_back({root, false});
+                while (!stack.empty()) {
+                    auto [formula, expanded] = stack.back();
+                    stack.pop_back();
+                    if (built[formula->id] != none)
+                        continue;
+                    switch (formula->type) {
+                        case FormulaType::Atom:
+                            built[formula->id] = variable(formula->token);
+                            break;
+                        case FormulaType::Unary: {
+                            auto op = (UnaryFormula*)formula;
+                            if (!expanded) {
+                                stack.push_back({formula, true});
+                                stack.push_back({op->right, false});
+                                break;
+                            }
+                            built[formula->id] = negate(built[op->right->id]);
+                            break;
+                        }
+                        case FormulaType::Binary:
+                            if (formula->token == Token::Implies) {
+                                auto op = (BinaryFormula*)formula;
+                                if (!expanded) {
+                                    stack.push_back({formula, true});
+                                    stack.push_back({op->right, false});
+                                    stack.push_back({op->left, false});
+                                    break;
+                                }
+                                built[formula->id] = implies(built[op->left->id], built[op->right->id]);
+                                break;
+                            }
+                            [[fallthrough]];
+                        // Case: an AND or OR - the whole run of it below,
+                        // however it is nested, joined at once
+                        case FormulaType::Nary: {
+                            if (!expanded) {
+                                stack.push_back({formula, true});
+                                runs.emplace_back();
+                                gather_run(formula, built, in_run, runs.back());
+                                for (std::size_t i = runs.back().size(); i-- > 0;)
+                                    stack.push_back({runs.back()[i], false});
+                                break;
+                            }
+                            operands.clear();
+                            for (auto operand : runs.back())
+                                operands.push_back(built[operand->id]);
+                            runs.pop_back();
+                            built[formula->id] = join(formula->token, operands);
+                            break;
+                        }
+                    }
+                }
+                roots.push_back(built[root->id]);
+            }
+            return join(Token::Or, roots);
+        }
+
+        // An assignment, by level, that leads from `f` to `target`, which
+        // must be reachable. Variables the path does not test are false.
+        std::vector<bool> path_to(Node f, Node target) {
+            std::vector<bool> assignment(order.size(), false);
+            // Whether `target` can be reached from each node, or -1 if not
+            // known yet
+            std::vector<std::int8_t> reaches(levels.size(), -1);
+            reaches[zero] = zero == target;
+            reaches[one] = one == target;
+            std::vector<Node> stack = {f};
+            while (!stack.empty()) {
+                Node node = stack.back();
+                if (reaches[node] >= 0) {
+                    stack.pop_back();
+                    continue;
+                }
+                if (reaches[lows[node]] < 0 or reaches[highs[node]] < 0) {
+                    stack.push_back(lows[node]);
+                    stack.push_back(highs[node]);
+                    continue;
+                }
+                reaches[node] = reaches[lows[node]] or reaches[highs[node]];
+                stack.pop_back();
+            }
+            while (f != target) {
+                bool high = !reaches[lows[f]];
+                assignment[levels[f]] = high;
+                f = high ? highs[f] : lows[f];
+            }
+            return assignment;
+        }
+
+        const std::vector<Token>& variables() const {
+            return order;
+        }
+
+        Statistics statistics() const {
+            Statistics stats;
+            stats.nodes = levels.size();
+            stats.bytes = levels.capacity() * sizeof(unsigned) + (lows.capacity() + highs.capacity() + unique.capacity()) * sizeof(Node)
+                        + cache.capacity() * sizeof(CacheEntry);
+            stats.cache_lookups = cache_lookups;
+            stats.cache_hits = cache_hits;
+            return stats;
+        }
+    };
+
+    // Static variable order: variables in the order they first appear when
+    // the formulas are read left to right, which keeps variables that are
+    // used together close together in the order
+    std::vector<Token> appearance_order(const FormulaFactory& factory, const std::vector<Formula*>& formulas) {
+        std::vector<Token> order;
+        std::vector<bool> visited(factory.size(), false);
+        std::vector<bool> placed(factory.num_variables(), false);
+        std::vector<Formula*> stack;
+        for (auto root : formulas) {
+            stack.push_back(root);
+            while (!stack.empty()) {
+                Formula* formula = stack.back();
+                stack.pop_back();
+                if (visited[formula->id])
+                    continue;
+                visited[formula->id] = true;
+                switch (formula->type) {
+                    case FormulaType::Atom:
+                        if (!placed[formula->token.id()]) {
+                            placed[formula->token.id()] = true;
+                            order.push_back(formula->token);
+                        }
+                        break;
+                    case FormulaType::Unary:
+                        stack.push_back(((UnaryFormula*)formula)->right);
+                        break;
+                    case FormulaType::Binary:
+                        stack.push_back(((BinaryFormula*)formula)->right);
+                        stack.push_back(((BinaryFormula*)formula)->left);
+                        break;
+                    case FormulaType::Nary: {
+                        auto op = (NaryFormula*)formula;
+                        for (unsigned i = op->arity; i-- > 0;)
+                            stack.push_back(op->operands[i]);
+                        break;
+                    }
+                }
+            }
+        }
+        return order;
+    }
+}
+
+#endif
@@ -0,0 +1,83 @@
+#include "bitset.hpp"
+#include "timer.hpp"
+
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+// Measures the throughput of whole-set bitset operations for each block
+// type and kernel policy, at sizes from a single word up to 1M bits.
+//
+// Build with `make bench` (or `make bench-native` to let the compiler use
+// every instruction set of the current machine) and run `./bitset-bench`.
+
+namespace {
+    volatile std::size_t sink;
+
+    // Repeats `op` until roughly `budget` seconds have passed, and returns
+    // the number of gigabytes of set data it touched per second
+    template<typename Op>
+    double throughput(std::size_t bytes_per_op, Op op, double budget = 0.05) {
+        std::size_t reps = 1;
+        while (true) {
+            timer t;
+            for (std::size_t r = 0; r < reps; r++)
+                op();
+            double time = t.get_time();
+            if (time >= budget)
+                return (double)bytes_per_op * reps / time / 1e9;
+            reps *= 2;
+        }
+    }
+
+    template<typename block, typename policy>
+    void run(const std::string& block_name) {
+        for (std::size_t bits : {64ul, 1ul << 10, 1ul << 14, 1ul << 18, 1ul << 20}) {
+            bitset<block, policy> a(bits), b(bits), zero(bits);
+            for (std::size_t i = 0; i < bits; i += 3)
+                a.set(i);
+            for (std::size_t i = 0; i < bits; i += 7)
+                b.set(i);
+            std::size_t bytes = (bits + 7) / 8;
+
+            // Repeated ANDs leave `a` as `a & b`, which costs the same to
+            // AND again, so `a` is only put back once they are timed
+            bitset<block, policy> saved = a;
+            double and_rate = throughput(bytes, [&]() { a &= b; sink = a.size(); });
+            a = saved;
+            double or_rate = throughput(bytes, [&]() { a |= b; sink = a.size(); });
+            double count_rate = throughput(bytes, [&]() { sink = a.count(); });
+            double any_rate = throughput(bytes, [&]() { sink = zero.any(); });
+
+            std::cout << std::left << std::setw(10) << block_name
+                      << std::setw(10) << policy::name
+                      << std::right << std::setw(9) << bits
+                      << std::fixed << std::setprecision(2)
+                      << std::setw(10) << and_rate
+                      << std::setw(10) << or_rate
+                      << std::setw(10) << count_rate
+                      << std::setw(10) << any_rate << std::endl;
+        }
+    }
+
+    template<typename block>
+    void run_policies(const std::string& block_name) {
+        run<block, bitset_policy::scalar>(block_name);
+#ifdef BITSET_X86
+        run<block, bitset_policy::sse2>(block_name);
+        if (bitset_policy::dispatch::has_avx2())
+            run<block, bitset_policy::avx2>(block_name);
+#endif
+    }
+}
+
+int main() {
+    std::cout << "Throughput in GB/s of set data (native policy: " << bitset_policy::native::name << ")" << std::endl;
+    std::cout << std::left << std::setw(10) << "block" << std::setw(10) << "policy"
+              << std::right << std::setw(9) << "bits"
+              << std::setw(10) << "and" << std::setw(10) << "or"
+              << std::setw(10) << "popcount" << std::setw(10) << "any" << std::endl;
+    run_policies<std::uint32_t>("uint32");
+    run_policies<std::uint64_t>("uint64");
+}
@@ -1,35 +1,382 @@
 #ifndef BITSET_HPP
 #define BITSET_HPP
 
+#include <algorithm>
 #include <bit>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
 #include <string>
 #include <sstream>
-#include <vector>
 
-template<typename block = unsigned int>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BITSET_X86
+#endif
+
+// Kernels for the whole-set operations of `bitset`. They treat the blocks
+// of a set as raw memory, so any policy works with any unsigned block type.
+namespace bitset_policy {
+
+    // One block at a time
+    struct scalar {
+        static constexpr const char* name = "scalar";
+
+        template<typename block>
+        static void and_assign(block* a, const block* b, std::size_t n) {
+            for (std::size_t i = 0; i < n; i++)
+                a[i] &= b[i];
+        }
+
+        template<typename block>
+        static void or_assign(block* a, const block* b, std::size_t n) {
+            for (std::size_t i = 0; i < n; i++)
+                a[i] |= b[i];
+        }
+
+        template<typename block>
+        static void xor_assign(block* a, const block* b, std::size_t n) {
+            for (std::size_t i = 0; i < n; i++)
+                a[i] ^= b[i];
+        }
+
+        template<typename block>
+        static void not_assign(block* a, std::size_t n) {
+            for (std::size_t i = 0; i < n; i++)
+                a[i] = ~a[i];
+        }
+
+        template<typename block>
+        static bool any(const block* a, std::size_t n) {
+            for (std::size_t i = 0; i < n; i++)
+                if (a[i])
+                    return true;
+            return false;
+        }
+
+        template<typename block>
+        static bool intersects(const block* a, const block* b, std::size_t n) {
+            for (std::size_t i = 0; i < n; i++)
+                if (a[i] & b[i])
+                    return true;
+            return false;
+        }
+
+        template<typename block>
+        static std::size_t count(const block* a, std::size_t n) {
+            std::size_t num = 0;
+            for (std::size_t i = 0; i < n; i++)
+                num += std::popcount(a[i]);
+            return num;
+        }
+    };
+
+#ifdef BITSET_X86
+    // Loops over `n` blocks of `a` (and `b`) as `vec`-sized pieces, handing
+    // any remainder to the scalar kernel
+    #define BITSET_VECTOR_LOOP(vec, body, tail)                                         \
+        std::size_t bytes = n * sizeof(block);                                          \
+        std::size_t i = 0;                                                              \
+        for (; i + sizeof(vec) <= bytes; i += sizeof(vec)) { body; }                    \
+        std::size_t done = i / sizeof(block);                                           \
+        tail;
+
+    // 128 bit vectors, available on every x86-64 processor
+    struct sse2 {
+        static constexpr const char* name = "sse2";
+
+        #define BITSET_SSE2_BINARY(fn, intrinsic)                                       \
+            template<typename block>                                                    \
+            __attribute__((target("sse2")))                                             \
+            static void fn(block* a, const block* b, std::size_t n) {                   \
+                char* pa = reinterpret_cast<char*>(a);                                  \
+                const char* pb = reinterpret_cast<const char*>(b);                      \
+                BITSET_VECTOR_LOOP(__m128i,                                             \
+                    __m128i x = _mm_loadu_si128((const __m128i*)(pa + i));              \
+                    __m128i y = _mm_loadu_si128((const __m128i*)(pb + i));              \
+                    _mm_storeu_si128((__m128i*)(pa + i), intrinsic(x, y)),              \
+                    scalar::fn(a + done, b + done, n - done))                           \
+            }
+        BITSET_SSE2_BINARY(and_assign, _mm_and_si128)
+        BITSET_SSE2_BINARY(or_assign, _mm_or_si128)
+        BITSET_SSE2_BINARY(xor_assign, _mm_xor_si128)
+        #undef BITSET_SSE2_BINARY
+
+        template<typename block>
+        __attribute__((target("sse2")))
+        static void not_assign(block* a, std::size_t n) {
+            char* pa = reinterpret_cast<char*>(a);
+            __m128i ones = _mm_set1_epi32(-1);
+            BITSET_VECTOR_LOOP(__m128i,
+                __m128i x = _mm_loadu_si128((const __m128i*)(pa + i));
+                _mm_storeu_si128((__m128i*)(pa + i), _mm_xor_si128(x, ones)),
+                scalar::not_assign(a + done, n - done))
+        }
+
+        template<typename block>
+        __attribute__((target("sse2")))
+        static bool any(const block* a, std::size_t n) {
+            const char* pa = reinterpret_cast<const char*>(a);
+            __m128i zero = _mm_setzero_si128();
+            BITSET_VECTOR_LOOP(__m128i,
+                __m128i x = _mm_loadu_si128((const __m128i*)(pa + i));
+                if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, zero)) != 0xFFFF)
+                    return true,
+                return scalar::any(a + done, n - done))
+        }
+
+        template<typename block>
+        __attribute__((target("sse2")))
+        static bool intersects(const block* a, const block* b, std::size_t n) {
+            const char* pa = reinterpret_cast<const char*>(a);
+            const char* pb = reinterpret_cast<const char*>(b);
+            __m128i zero = _mm_setzero_si128();
+            BITSET_VECTOR_LOOP(__m128i,
+                __m128i x = _mm_loadu_si128((const __m128i*)(pa + i));
+                __m128i y = _mm_loadu_si128((const __m128i*)(pb + i));
+                if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(x, y), zero)) != 0xFFFF)
+                    return true,
+                return scalar::intersects(a + done, b + done, n - done))
+        }
+
+        template<typename block>
+        static std::size_t count(const block* a, std::size_t n) {
+            if constexpr (sizeof(block) < sizeof(std::uint64_t)) {
+                return scalar::count(a, n);
+            } else {
+                return scalar::count(reinterpret_cast<const std::uint64_t*>(a), n * sizeof(block) / sizeof(std::uint64_t));
+            }
+        }
+    };
+
+    // 256 bit vectors. The kernels are compiled for AVX2 whatever the build
+    // flags, so only call them after checking the processor supports it.
+    struct avx2 {
+        static constexpr const char* name = "avx2";
+
+        #define BITSET_AVX2_BINARY(fn, intrinsic)                                       \
+            template<typename block>                                                    \
+            __attribute__((target("avx2")))                                             \
+            static void fn(block* a, const block* b, std::size_t n) {                   \
+                char* pa = reinterpret_cast<char*>(a);                                  \
+                const char* pb = reinterpret_cast<const char*>(b);                      \
+                BITSET_VECTOR_LOOP(__m256i,                                             \
+                    __m256i x = _mm256_loadu_si256((const __m256i*)(pa + i));           \
+                    __m256i y = _mm256_loadu_si256((const __m256i*)(pb + i));           \
+                    _mm256_storeu_si256((__m256i*)(pa + i), intrinsic(x, y)),           \
+                    sse2::fn(a + done, b + done, n - done))                             \
+            }
+        BITSET_AVX2_BINARY(and_assign, _mm256_and_si256)
+        BITSET_AVX2_BINARY(or_assign, _mm256_or_si256)
+        BITSET_AVX2_BINARY(xor_assign, _mm256_xor_si256)
+        #undef BITSET_AVX2_BINARY
+
+        template<typename block>
+        __attribute__((target("avx2")))
+        static void not_assign(block* a, std::size_t n) {
+            char* pa = reinterpret_cast<char*>(a);
+            __m256i ones = _mm256_set1_epi32(-1);
+            BITSET_VECTOR_LOOP(__m256i,
+                __m256i x = _mm256_loadu_si256((const __m256i*)(pa + i));
+                _mm256_storeu_si256((__m256i*)(pa + i), _mm256_xor_si256(x, ones)),
+                sse2::not_assign(a + done, n - done))
+        }
+
+        template<typename block>
+        __attribute__((target("avx2")))
+        static bool any(const block* a, std::size_t n) {
+            const char* pa = reinterpret_cast<const char*>(a);
+            BITSET_VECTOR_LOOP(__m256i,
+                __m256i x = _mm256_loadu_si256((const __m256i*)(pa + i));
+                if (!_mm256_testz_si256(x, x))
+                    return true,
+                return sse2::any(a + done, n - done))
+        }
+
+        template<typename block>
+        __attribute__((target("avx2")))
+        static bool intersects(const block* a, const block* b, std::size_t n) {
+            const char* pa = reinterpret_cast<const char*>(a);
+            const char* pb = reinterpret_cast<const char*>(b);
+            BITSET_VECTOR_LOOP(__m256i,
+                __m256i x = _mm256_loadu_si256((const __m256i*)(pa + i));
+                __m256i y = _mm256_loadu_si256((const __m256i*)(pb + i));
+                if (!_mm256_testz_si256(x, y))
+                    return true,
+                return sse2::intersects(a + done, b + done, n - done))
+        }
+
+        // Population count by nibble lookup (Mula's method), summing the
+        // byte counts of each vector with `vpsadbw`
+        template<typename block>
+        __attribute__((target("avx2")))
+        static std::size_t count(const block* a, std::size_t n) {
+            const char* pa = reinterpret_cast<const char*>(a);
+            const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                                    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+            const __m256i low_mask = _mm256_set1_epi8(0x0F);
+            __m256i total = _mm256_setzero_si256();
+            std::size_t num = 0;
+            BITSET_VECTOR_LOOP(__m256i,
+                __m256i x = _mm256_loadu_si256((const __m256i*)(pa + i));
+                __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(x, low_mask));
+                __m256i hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(x, 4), low_mask));
+                total = _mm256_add_epi64(total, _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256())),
+                num = sse2::count(a + done, n - done))
+            std::uint64_t lanes[4];
+            _mm256_storeu_si256((__m256i*)lanes, total);
+            return num + lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        }
+    };
+
+    #undef BITSET_VECTOR_LOOP
+
+    // Picks AVX2 or SSE2 when the set is first used, based on the processor
+    // the program is running on
+    struct dispatch {
+        static constexpr const char* name = "dispatch";
+
+        static bool has_avx2() {
+            static const bool supported = __builtin_cpu_supports("avx2");
+            return supported;
+        }
+
+        template<typename block>
+        static void and_assign(block* a, const block* b, std::size_t n) {
+            has_avx2() ? avx2::and_assign(a, b, n) : sse2::and_assign(a, b, n);
+        }
+
+        template<typename block>
+        static void or_assign(block* a, const block* b, std::size_t n) {
+            has_avx2() ? avx2::or_assign(a, b, n) : sse2::or_assign(a, b, n);
+        }
+
+        template<typename block>
+        static void xor_assign(block* a, const block* b, std::size_t n) {
+            has_avx2() ? avx2::xor_assign(a, b, n) : sse2::xor_assign(a, b, n);
+        }
+
+        template<typename block>
+        static void not_assign(block* a, std::size_t n) {
+            has_avx2() ? avx2::not_assign(a, n) : sse2::not_assign(a, n);
+        }
+
+        template<typename block>
+        static bool any(const block* a, std::size_t n) {
+            return has_avx2() ? avx2::any(a, n) : sse2::any(a, n);
+        }
+
+        template<typename block>
+        static bool intersects(const block* a, const block* b, std::size_t n) {
+            return has_avx2() ? avx2::intersects(a, b, n) : sse2::intersects(a, b, n);
+        }
+
+        template<typename block>
+        static std::size_t count(const block* a, std::size_t n) {
+            return has_avx2() ? avx2::count(a, n) : sse2::count(a, n);
+        }
+    };
+#endif
+
+    // The widest kernels the compiler was told it may use
+#if defined(__AVX2__)
+    using native = avx2;
+#elif defined(BITSET_X86)
+    using native = sse2;
+#else
+    using native = scalar;
+#endif
+}
+
+// Bits are stored inline for sets of up to `inline_bits` bits, so that small
+// sets and the results of operators on them never touch the heap. Whole-set
+// operations are carried out by the kernels of `policy`.
+template<typename block = std::uint64_t, typename policy = bitset_policy::native, std::size_t inline_bits = 256>
 class bitset {
     static constexpr std::size_t blocksize = sizeof(block) << 3;
+    static constexpr std::size_t inline_blocks = (inline_bits + blocksize - 1)/blocksize;
     static constexpr block set_block = static_cast<block>(-1);
     static constexpr block reset_block = static_cast<block>(0);
     std::size_t aloc;
     std::size_t N;
     block last_mask;
-    std::vector<block> data;
+    block* data;
+    block local[inline_blocks];
+
+    bool is_local() const {
+        return aloc <= inline_blocks;
+    }
+
+    void allocate() {
+        data = is_local() ? local : new block[aloc];
+    }
 
 public:
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
     bitset(std::size_t N): N(N) {
         aloc = (N + blocksize - 1)/blocksize;
-        last_mask = set_block >> (blocksize - (N % blocksize));
-        data = std::vector<block>(aloc, reset_block);
+        last_mask = (N % blocksize == 0) ? set_block : set_block >> (blocksize - (N % blocksize));
+        allocate();
+        std::fill(data, data + aloc, reset_block);
     }
 
-    bool operator==(const bitset<block>& rhs) const {
+    bitset(const bitset<block, policy, inline_bits>& other): aloc(other.aloc), N(other.N), last_mask(other.last_mask) {
+        allocate();
+        std::copy(other.data, other.data + aloc, data);
+    }
+
+    bitset(bitset<block, policy, inline_bits>&& other): aloc(other.aloc), N(other.N), last_mask(other.last_mask) {
+        if (other.is_local()) {
+            data = local;
+            std::copy(other.data, other.data + aloc, data);
+        } else {
+            data = other.data;
+            other.aloc = other.N = 0;
+            other.data = other.local;
+        }
+    }
+
+    bitset<block, policy, inline_bits>& operator=(const bitset<block, policy, inline_bits>& other) {
+        if (this == &other)
+            return *this;
+        if (aloc != other.aloc) {
+            if (!is_local())
+                delete[] data;
+            aloc = other.aloc;
+            allocate();
+        }
+        N = other.N;
+        last_mask = other.last_mask;
+        std::copy(other.data, other.data + aloc, data);
+        return *this;
+    }
+
+    bitset<block, policy, inline_bits>& operator=(bitset<block, policy, inline_bits>&& other) {
+        if (this == &other)
+            return *this;
+        if (other.is_local())
+            return *this = static_cast<const bitset<block, policy, inline_bits>&>(other);
+        if (!is_local())
+            delete[] data;
+        aloc = other.aloc;
+        N = other.N;
+        last_mask = other.last_mask;
+        data = other.data;
+        other.aloc = other.N = 0;
+        other.data = other.local;
+        return *this;
+    }
+
+    ~bitset() {
+        if (!is_local())
+            delete[] data;
+    }
+
+    bool operator==(const bitset<block, policy, inline_bits>& rhs) const {
         if (N != rhs.N)
             return false;
-        for (int i = 0; i < aloc; i++)
-            if (data[i] != rhs.data[i])
-            return false;
-        return true;
+        return std::memcmp(data, rhs.data, aloc * sizeof(block)) == 0;
     }
         
     bool operator[](std::size_t pos) const {
@@ -43,199 +390,239 @@ public:
     }
 
     bool all() const {
-        for (int i = 0; i < aloc-1; i++)
+        if (aloc == 0)
+            return true;
+        for (std::size_t i = 0; i < aloc-1; i++)
             if (data[i] != set_block)
             return false;
         return data[aloc-1] == last_mask;
     }
 
     bool any() const {
-        for (int i = 0; i < aloc; i++)
-            if (data[i] != reset_block)
-            return true;
-        return false;
+        return policy::any(data, aloc);
     }
 
     std::size_t count() const {
-        std::size_t num = 0;
-        for (int i = 0; i < aloc; i++)
-            num += std::popcount(data[i]);
-        return num;
+        return policy::count(data, aloc);
     }
 
     std::size_t size() const {
         return N;
     }
 
-    bitset<block>& operator&=(const bitset<block>& other) {
-        for (int i = 0; i < std::min(aloc, other.aloc); i++)
-            data[i] &= other.data[i];
+    bitset<block, policy, inline_bits>& operator&=(const bitset<block, policy, inline_bits>& other) {
+        policy::and_assign(data, other.data, std::min(aloc, other.aloc));
         return *this;
     }
 
-    bitset<block> operator&(const bitset<block>& other) {
-        bitset<block> res = this->copy();
+    bitset<block, policy, inline_bits> operator&(const bitset<block, policy, inline_bits>& other) const {
+        bitset<block, policy, inline_bits> res = this->copy();
         res &= other;
         return res;
     }
 
-    bitset<block>& operator|=(const bitset<block>& other) {
-        for (int i = 0; i < std::min(aloc, other.aloc); i++)
-            data[i] |= other.data[i];
-        if (aloc <= other.aloc)
+    bitset<block, policy, inline_bits>& operator|=(const bitset<block, policy, inline_bits>& other) {
+        policy::or_assign(data, other.data, std::min(aloc, other.aloc));
+        if (aloc > 0 and aloc <= other.aloc)
             data[aloc-1] &= last_mask;
         return *this;
     }
 
-    bitset<block> operator|(const bitset<block>& other) {
-        bitset<block> res = this->copy();
+    bitset<block, policy, inline_bits> operator|(const bitset<block, policy, inline_bits>& other) const {
+        bitset<block, policy, inline_bits> res = this->copy();
         res |= other;
         return res;
     }
 
-    bitset<block>& operator^=(const bitset<block>& other) {
-        for (int i = 0; i < std::min(aloc, other.aloc); i++)
-            data[i] ^= other.data[i];
-        if (aloc <= other.aloc)
+    bitset<block, policy, inline_bits>& operator^=(const bitset<block, policy, inline_bits>& other) {
+        policy::xor_assign(data, other.data, std::min(aloc, other.aloc));
+        if (aloc > 0 and aloc <= other.aloc)
             data[aloc-1] &= last_mask;
         return *this;
     }
 
-    bitset<block> operator^(const bitset<block>& other) {
-        bitset<block> res = this->copy();
+    bitset<block, policy, inline_bits> operator^(const bitset<block, policy, inline_bits>& other) const {
+        bitset<block, policy, inline_bits> res = this->copy();
         res ^= other;
         return res;
     }
 
-    bitset<block>& flip() {
-        for (int i = 0; i < aloc-1; i++)
-            data[i] = ~data[i];
-        data[aloc-1] = (~data[aloc-1]) & last_mask;
+    bitset<block, policy, inline_bits>& flip() {
+        if (aloc == 0)
+            return *this;
+        policy::not_assign(data, aloc);
+        data[aloc-1] &= last_mask;
         return *this;
     }
 
-    bitset<block> operator~() const {
-        bitset<block> res = this->copy();
+    bitset<block, policy, inline_bits> operator~() const {
+        bitset<block, policy, inline_bits> res = this->copy();
         res.flip();
         return res;
     }
 
-    bitset<block>& operator<<=(std::size_t pos) {
+    bitset<block, policy, inline_bits>& operator<<=(std::size_t pos) {
         std::size_t step = pos / blocksize;
+        if (step >= aloc)
+            return reset();
         if (step > 0) {
-            for (int i = aloc-1; i >= step; i--)
+            for (std::size_t i = aloc; i-- > step;)
             data[i] = data[i-step];
-            for (int i = step-1; i >= 0; i--)
+            for (std::size_t i = 0; i < step; i++)
             data[i] = reset_block;
         }
         pos %= blocksize;
-        block c = reset_block;
-        block nc;
-        for (int i = step; i < aloc; i++) {
-            nc = data[i] >> (blocksize - pos);
-            data[i] = (data[i] << pos) | c;
-            c = nc;
+        if (pos > 0) {
+            block c = reset_block;
+            block nc;
+            for (std::size_t i = step; i < aloc; i++) {
+                nc = data[i] >> (blocksize - pos);
+                data[i] = (data[i] << pos) | c;
+                c = nc;
+            }
         }
         data[aloc-1] &= last_mask;
         return *this;
     }
 
-    bitset<block>& operator>>=(std::size_t pos) {
+    bitset<block, policy, inline_bits>& operator>>=(std::size_t pos) {
         std::size_t step = pos / blocksize;
+        if (step >= aloc)
+            return reset();
         if (step > 0) {
-            for (int i = 0; i < aloc-step; i++)
+            for (std::size_t i = 0; i < aloc-step; i++)
             data[i] = data[i+step];
-            for (int i = aloc-step; i < aloc; i++)
+            for (std::size_t i = aloc-step; i < aloc; i++)
             data[i] = reset_block;
         }
         pos %= blocksize;
-        block c = reset_block;
-        block nc;
-        for (int i = aloc-1-step; i >= 0; i--) {
-            nc = data[i] << (blocksize - pos);
-            data[i] = c | (data[i] >> pos);
-            c = nc;
+        if (pos > 0) {
+            block c = reset_block;
+            block nc;
+            for (std::size_t i = aloc-step; i-- > 0;) {
+                nc = data[i] << (blocksize - pos);
+                data[i] = c | (data[i] >> pos);
+                c = nc;
+            }
         }
         return *this;
     }
 
-    bitset<block> copy() const {
-        bitset<block> res(N);
-        for (int i = 0; i < aloc; i++)
-            res.data[i] = data[i];
-        return res;
+    bitset<block, policy, inline_bits> copy() const {
+        return *this;
     }
 
-    bitset<block> operator<<(std::size_t pos) const {
-        bitset<block> res = this->copy();
+    bitset<block, policy, inline_bits> operator<<(std::size_t pos) const {
+        bitset<block, policy, inline_bits> res = this->copy();
         return res <<= pos;
     }
 
-    bitset<block> operator>>(std::size_t pos) const {
-        bitset<block> res = this->copy();
+    bitset<block, policy, inline_bits> operator>>(std::size_t pos) const {
+        bitset<block, policy, inline_bits> res = this->copy();
         return res >>= pos;
     }
 
-    bitset<block>& set() {
-        for (int i = 0; i < aloc-1; i++)
-            data[i] = set_block;
+    bitset<block, policy, inline_bits>& set() {
+        if (aloc == 0)
+            return *this;
+        std::fill(data, data + aloc-1, set_block);
         data[aloc-1] = last_mask;
         return *this;
     }
 
-    bitset<block>& reset() {
-        for (int i = 0; i < aloc; i++)
-            data[i] = reset_block;
+    bitset<block, policy, inline_bits>& reset() {
+        std::fill(data, data + aloc, reset_block);
         return *this;
     }
 
-    bitset<block>& reset(std::size_t pos) {
+    bitset<block, policy, inline_bits>& reset(std::size_t pos) {
         std::size_t step = pos / blocksize;
-        block mask = ~(1 << (pos % blocksize));
+        block mask = ~(static_cast<block>(1) << (pos % blocksize));
         data[step] &= mask;
         return *this;
     }
 
-    bitset<block>& set(std::size_t pos, bool value = true) {
+    bitset<block, policy, inline_bits>& set(std::size_t pos, bool value = true) {
         if (!value)
             return this->reset(pos);
         std::size_t step = pos / blocksize;
-        block mask = 1 << (pos % blocksize);
+        block mask = static_cast<block>(1) << (pos % blocksize);
         data[step] |= mask;
         return *this;
     }
 
-    bitset<block>& flip(size_t pos) {
+    bitset<block, policy, inline_bits>& flip(size_t pos) {
         std::size_t step = pos / blocksize;
-        block mask = 1 << (pos % blocksize);
+        block mask = static_cast<block>(1) << (pos % blocksize);
         data[step] ^= mask;
         return *this;
     }
 
-    std::string to_string(char zero = '0', char one = '1') const {
-        std::stringstream ss;
-        block curr = data[aloc-1];
-        block mask = 1 << ((N % blocksize) - 1);
-        while (mask != 0) {
-            if (curr & mask)
-            ss << one;
-            else
-            ss << zero;
-            mask >>= 1;
-        }
-        for (int i = aloc-2; i >= 0; i--) {
+    // Whether the two sets share a bit, without building their intersection
+    bool intersects(const bitset<block, policy, inline_bits>& other) const {
+        return policy::intersects(data, other.data, std::min(aloc, other.aloc));
+    }
+
+    bool is_subset_of(const bitset<block, policy, inline_bits>& other) const {
+        for (std::size_t i = 0; i < aloc; i++) {
+            block theirs = i < other.aloc ? other.data[i] : reset_block;
+            if (data[i] & ~theirs)
+                return false;
+        }
+        return true;
+    }
+
+    // Position of the lowest set bit, or `npos` if there is none
+    std::size_t find_first() const {
+        for (std::size_t i = 0; i < aloc; i++)
+            if (data[i] != reset_block)
+                return i * blocksize + std::countr_zero(data[i]);
+        return npos;
+    }
+
+    // Position of the lowest set bit after `pos`, or `npos` if there is none
+    std::size_t find_next(std::size_t pos) const {
+        pos++;
+        if (pos >= N)
+            return npos;
+        std::size_t i = pos / blocksize;
+        block curr = data[i] & static_cast<block>(set_block << (pos % blocksize));
+        while (curr == reset_block) {
+            if (++i >= aloc)
+                return npos;
             curr = data[i];
-            mask = 1 << (blocksize-1);
-            while (mask != 0) {
-            if (curr & mask)
-                ss << one;
-            else
-                ss << zero;
-            mask >>= 1;
+        }
+        return i * blocksize + std::countr_zero(curr);
+    }
+
+    // Calls `f(pos)` for every set bit, in increasing order
+    template<typename F>
+    void for_each(F f) const {
+        for (std::size_t i = 0; i < aloc; i++) {
+            block curr = data[i];
+            while (curr != reset_block) {
+                f(i * blocksize + std::countr_zero(curr));
+                curr &= curr - 1;
             }
         }
+    }
+
+    std::string to_string(char zero = '0', char one = '1') const {
+        std::stringstream ss;
+        for (std::size_t pos = N; pos-- > 0;)
+            ss << ((*this)[pos] ? one : zero);
         return ss.str();
     }
 };
 
+template<typename block, typename policy, std::size_t inline_bits>
+bool intersects(const bitset<block, policy, inline_bits>& a, const bitset<block, policy, inline_bits>& b) {
+    return a.intersects(b);
+}
+
+template<typename block, typename policy, std::size_t inline_bits>
+bool is_subset_of(const bitset<block, policy, inline_bits>& a, const bitset<block, policy, inline_bits>& b) {
+    return a.is_subset_of(b);
+}
+
 #endif
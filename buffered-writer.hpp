@@ -0,0 +1,52 @@
+#ifndef BUFFERED_WRITER_HPP
+#define BUFFERED_WRITER_HPP
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+// Collects text in memory and hands it to a stream in large blocks, rather
+// than a line at a time, and never flushes the stream in between. Text is
+// appended straight to `buffer()`, and `commit` writes it out once a block
+// has built up. Whatever is left is written by `flush`, or when the writer
+// is destroyed.
+class buffered_writer {
+    std::ostream& out;
+    std::string text;
+    std::size_t block;
+
+    void write() {
+        out.write(text.data(), text.size());
+        text.clear();
+    }
+
+public:
+    explicit buffered_writer(std::ostream& out, std::size_t block = 1 << 16) : out(out), block(block) {
+        text.reserve(block);
+    }
+
+    buffered_writer(const buffered_writer&) = delete;
+    buffered_writer& operator=(const buffered_writer&) = delete;
+
+    ~buffered_writer() {
+        flush();
+    }
+
+    std::string& buffer() {
+        return text;
+    }
+
+    // Writes the buffered text out if a whole block has built up
+    void commit() {
+        if (text.size() >= block)
+            write();
+    }
+
+    // Writes the buffered text out, and flushes the stream
+    void flush() {
+        write();
+        out.flush();
+    }
+};
+
+#endif
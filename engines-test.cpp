@@ -0,0 +1,620 @@
+#include "rs-system.cpp"
+#include "batch.cpp"
+#include "timer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// Checks that every engine, and the RS engine under each of its settings,
+// gives the same answer as trying every assignment, on random formulas
+// small enough to try them all. Every counterexample an engine gives must
+// make each of the formulas false. Long chains are also checked, to catch
+// passes that take time quadratic in their length, as are telling whether
+// two formulas are equivalent, giving up once a limit is reached, reading
+// large inputs on several threads, reading files, and answering a batch of
+// queries.
+//
+// Build and run with `make test`.
+
+namespace {
+    // A node of a random formula: a variable, or a connective over the
+    // nodes in `operands`
+    struct Expr {
+        char op;
+        unsigned variable;
+        std::vector<std::size_t> operands;
+    };
+
+    // Variable names, which must not start with `v`
+    const char* const names[] = {"a", "b", "c", "d", "e", "f", "g", "h"};
+
+    class Generator {
+        std::uint64_t state;
+
+    public:
+        std::vector<Expr> exprs;
+
+        explicit Generator(std::uint64_t seed) : state(seed) {}
+
+        unsigned next(unsigned bound) {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            return (state >> 33) % bound;
+        }
+
+        std::size_t add(Expr expr) {
+            exprs.push_back(std::move(expr));
+            return exprs.size() - 1;
+        }
+
+        // A formula over `variables` variables, at most `depth` deep. AND
+        // and OR take two to four operands.
+        std::size_t formula(unsigned variables, unsigned depth) {
+            unsigned kind = depth == 0 ? 0 : next(6);
+            if (kind <= 1)
+                return add({'x', next(variables), {}});
+            if (kind == 2)
+                return add({'~', 0, {formula(variables, depth - 1)}});
+            if (kind == 3) {
+                std::size_t left = formula(variables, depth - 1);
+                return add({'>', 0, {left, formula(variables, depth - 1)}});
+            }
+            Expr expr{kind == 4 ? '^' : 'v', 0, {}};
+            for (unsigned i = 2 + next(3); i > 0; i--)
+                expr.operands.push_back(formula(variables, depth - 1));
+            return add(std::move(expr));
+        }
+
+        // A formula equivalent to `i`, with implications written as ORs and
+        // negations pushed down to the variables
+        std::size_t rewrite(std::size_t i, bool negated) {
+            Expr expr = exprs[i];
+            switch (expr.op) {
+                case 'x':
+                    return negated ? add({'~', 0, {i}}) : i;
+                case '~':
+                    return rewrite(expr.operands[0], !negated);
+                case '>': {
+                    std::size_t left = rewrite(expr.operands[0], !negated);
+                    std::size_t right = rewrite(expr.operands[1], negated);
+                    return add({negated ? '^' : 'v', 0, {left, right}});
+                }
+                default: {
+                    Expr result{(expr.op == '^') != negated ? '^' : 'v', 0, {}};
+                    for (auto operand : expr.operands)
+                        result.operands.push_back(rewrite(operand, negated));
+                    return add(std::move(result));
+                }
+            }
+        }
+
+        std::string text(std::size_t i) const {
+            const Expr& expr = exprs[i];
+            switch (expr.op) {
+                case 'x':
+                    return names[expr.variable];
+                case '~':
+                    return "~(" + text(expr.operands[0]) + ")";
+                case '>':
+                    return "(" + text(expr.operands[0]) + ") -> (" + text(expr.operands[1]) + ")";
+                default: {
+                    std::string s;
+                    for (std::size_t j = 0; j < expr.operands.size(); j++) {
+                        if (j > 0)
+                            s += expr.op == '^' ? " ^ " : " v ";
+                        s += "(" + text(expr.operands[j]) + ")";
+                    }
+                    return s;
+                }
+            }
+        }
+
+        // The value of `i` when variable `n` has bit `n` of `assignment`
+        bool evaluate(std::size_t i, std::uint64_t assignment) const {
+            const Expr& expr = exprs[i];
+            switch (expr.op) {
+                case 'x':
+                    return (assignment >> expr.variable) & 1;
+                case '~':
+                    return !evaluate(expr.operands[0], assignment);
+                case '>':
+                    return !evaluate(expr.operands[0], assignment) or evaluate(expr.operands[1], assignment);
+                default:
+                    for (auto operand : expr.operands)
+                        if (evaluate(operand, assignment) != (expr.op == '^'))
+                            return expr.op != '^';
+                    return expr.op == '^';
+            }
+        }
+    };
+
+    struct Setting {
+        const char* name;
+        RSSystem::Options options;
+    };
+
+    std::vector<Setting> settings() {
+        std::vector<Setting> settings;
+        auto add = [&](const char* name, auto configure) {
+            RSSystem::Options options;
+            configure(options);
+            settings.push_back({name, options});
+        };
+        add("rs", [](auto& o) { o.engine = RSSystem::Engine::RS; });
+        add("rs alpha memo", [](auto& o) { o.engine = RSSystem::Engine::RS; o.schedule = RSSystem::Schedule::AlphaFirst; o.memo_bytes = 1 << 20; });
+        add("rs no-backjump", [](auto& o) { o.engine = RSSystem::Engine::RS; o.backjump = false; });
+        add("rs 4 threads", [](auto& o) { o.engine = RSSystem::Engine::RS; o.threads = 4; });
+        add("truth-table", [](auto& o) { o.engine = RSSystem::Engine::TruthTable; });
+        add("truth-table 4 threads", [](auto& o) { o.engine = RSSystem::Engine::TruthTable; o.threads = 4; });
+        add("sat", [](auto& o) { o.engine = RSSystem::Engine::SAT; });
+        add("bdd", [](auto& o) { o.engine = RSSystem::Engine::BDD; });
+        add("auto preprocess", [](auto& o) { o.preprocess = true; });
+        add("rs preprocess", [](auto& o) { o.engine = RSSystem::Engine::RS; o.preprocess = true; });
+        return settings;
+    }
+
+    std::size_t failures = 0;
+
+    void fail(const std::string& what, const std::vector<std::string>& formulas = {}) {
+        failures++;
+        std::cout << "FAIL: " << what;
+        for (auto& formula : formulas)
+            std::cout << " [" << formula << "]";
+        std::cout << std::endl;
+    }
+
+    // Decides the formulas of one case with every setting
+    void check_case(const Generator& generator, const std::vector<std::size_t>& roots, unsigned variables) {
+        std::vector<std::string> formulas;
+        for (auto root : roots)
+            formulas.push_back(generator.text(root));
+        bool expected = true;
+        for (std::uint64_t assignment = 0; assignment < (std::uint64_t(1) << variables) and expected; assignment++) {
+            bool value = false;
+            for (auto root : roots)
+                value = value or generator.evaluate(root, assignment);
+            expected = value;
+        }
+
+        std::vector<std::string_view> views(formulas.begin(), formulas.end());
+        for (const Setting& setting : settings()) {
+            RSSystem::Session session;
+            RSSystem::Result result = RSSystem::check(session, views, setting.options);
+            if (result.verdict != (expected ? RSSystem::Verdict::Tautology : RSSystem::Verdict::NotTautology)) {
+                fail(std::string(setting.name) + " answered " + RSSystem::to_str(result.verdict), formulas);
+                continue;
+            }
+            if (expected)
+                continue;
+            std::uint64_t assignment = 0;
+            for (unsigned variable = 0; variable < variables; variable++) {
+                // Variables that do not appear in the formulas are left false
+                bool known = false;
+                for (unsigned id = 0; id < session.symbols.num_variables(); id++)
+                    if (session.symbols.name(Tokenizer::Token::Variable(id)) == names[variable])
+                        known = result.counterexample[id];
+                assignment |= std::uint64_t(known) << variable;
+            }
+            for (auto root : roots)
+                if (generator.evaluate(root, assignment))
+                    fail(std::string(setting.name) + " gave a counterexample that does not falsify", formulas);
+        }
+    }
+
+    // Name of the `i`th variable, made of letters only, and never starting
+    // with `v`
+    std::string variable(std::size_t i) {
+        std::string name(1, 'a' + i % 21);
+        for (i /= 21; i > 0; i /= 26)
+            name += (char)('a' + i % 26);
+        return name;
+    }
+
+    // `(((a op b) op c) ... op last)` over `length` variables, each
+    // operator in parentheses of its own
+    std::string left_nested(const char* op, std::size_t length, const std::string& last) {
+        std::string s(length - 1, '(');
+        s += variable(0);
+        for (std::size_t i = 1; i < length; i++)
+            s += std::string(" ") + op + " " + (i + 1 == length ? last : variable(i)) + ")";
+        return s;
+    }
+
+    // Preprocessing gathers each run of `^` or `v` once, however deeply it
+    // is nested, so long chains take about as long as they do without it
+    void check_long_chains() {
+        constexpr std::size_t length = 40000;
+        RSSystem::Options options;
+        options.preprocess = true;
+        struct Case {
+            const char* name;
+            std::string formula;
+            RSSystem::Verdict expected;
+        };
+        Case cases[] = {
+            {"long chain of ^", left_nested("^", length, variable(length - 1)), RSSystem::Verdict::NotTautology},
+            {"long chain of v", left_nested("v", length, "~" + variable(0)), RSSystem::Verdict::Tautology},
+        };
+        for (const Case& c : cases) {
+            std::string_view view = c.formula;
+            RSSystem::Session session;
+            timer t;
+            RSSystem::Result result = RSSystem::check(session, std::span(&view, 1), options);
+            double time = t.get_time();
+            std::string name = c.name;
+            if (result.verdict != c.expected)
+                fail(name + " answered " + RSSystem::to_str(result.verdict));
+            else if (result.stats.preprocess_nodes_after > length + 1)
+                fail(name + " kept " + std::to_string(result.stats.preprocess_nodes_after) + " nodes");
+            else if (time > 5)
+                fail(name + " took " + std::to_string(time) + " s");
+        }
+    }
+
+    // What a check gave, reduced to what must not depend on the number of
+    // threads reading the input
+    struct Outcome {
+        std::string error;
+        RSSystem::Verdict verdict = RSSystem::Verdict::Unknown;
+        std::size_t nodes = 0;
+        std::vector<std::string> variables;
+        std::vector<bool> counterexample;
+
+        bool operator==(const Outcome&) const = default;
+    };
+
+    // Reads `lines` as a list of formulas if `as_list`, and as text one per
+    // line otherwise
+    Outcome read(const std::vector<std::string>& lines, bool as_list, unsigned threads) {
+        RSSystem::Options options;
+        options.engine = RSSystem::Engine::SAT;
+        options.threads = threads;
+        RSSystem::Session session;
+        Outcome outcome;
+        try {
+            RSSystem::Result result;
+            if (as_list) {
+                std::vector<std::string_view> views(lines.begin(), lines.end());
+                result = RSSystem::check(session, views, options);
+            } else {
+                std::string text;
+                for (auto& line : lines)
+                    text += line + "\n";
+                result = RSSystem::check_lines(session, text, options);
+            }
+            outcome.verdict = result.verdict;
+            outcome.nodes = result.stats.formula_nodes;
+            outcome.counterexample = result.counterexample;
+            for (unsigned id = 0; id < session.symbols.num_variables(); id++)
+                outcome.variables.push_back(std::string(session.symbols.name(Tokenizer::Token::Variable(id))));
+        } catch (const std::exception& e) {
+            // What the session's symbol table holds after an error is not
+            // part of the answer, and is cleared by the next check
+            outcome.error = e.what();
+        }
+        return outcome;
+    }
+
+    // Inputs large enough to be read on several threads give the same
+    // nodes, variable numbering, answer and first error as on one thread
+    std::size_t check_parallel_reading() {
+        // Well over `min_parallel_bytes`, over thousands of variables that
+        // come up in every part of the input, with subformulas repeated
+        // across parts
+        Generator generator(7);
+        std::vector<std::string> lines;
+        std::size_t bytes = 0;
+        while (bytes < 3 * RSSystem::min_parallel_bytes / 2) {
+            std::string line = "(" + variable(generator.next(5000)) + " ^ ~" + variable(generator.next(5000)) + ") v ("
+                + variable(generator.next(50)) + " -> " + variable(generator.next(5000)) + ")";
+            bytes += line.size() + 1;
+            lines.push_back(std::move(line));
+        }
+        std::size_t size = lines.size();
+        struct Case {
+            const char* name;
+            std::vector<std::pair<std::size_t, std::string>> changes;
+        };
+        Case cases[] = {
+            {"input read", {}},
+            {"input with a bad character late", {{size * 3 / 4, "(a v $b)"}}},
+            {"input with an early syntax error", {{size / 4, "(a v b"}, {size * 3 / 4, "(a v $b)"}}},
+            {"input with two errors close by", {{size * 3 / 4, "(a v b))"}, {size * 3 / 4 + 5, "(a v %b)"}}},
+            {"input with an error on its last line", {{size - 1, "a ^"}}},
+        };
+        std::size_t count = 0;
+        for (const Case& c : cases) {
+            std::vector<std::string> input = lines;
+            for (auto& [line, text] : c.changes)
+                input[line] = text;
+            for (bool as_list : {true, false}) {
+                std::string name = std::string(c.name) + (as_list ? " as a list" : " as lines");
+                Outcome serial = read(input, as_list, 1);
+                if (c.changes.empty() == !serial.error.empty())
+                    fail(name + " on one thread gave " + (serial.error.empty() ? "no error" : serial.error));
+                for (unsigned threads : {2u, 4u})
+                    if (read(input, as_list, threads) != serial)
+                        fail(name + " on " + std::to_string(threads) + " threads differs from one thread");
+                count++;
+            }
+        }
+        return count;
+    }
+
+    // A file for the test to write and read, removed when done with
+    class TempFile {
+        std::filesystem::path file;
+
+    public:
+        explicit TempFile(const std::string& name)
+            : file(std::filesystem::temp_directory_path() / ("engines-test-" + std::to_string(getpid()) + "-" + name)) {}
+
+        TempFile(const TempFile&) = delete;
+        TempFile& operator=(const TempFile&) = delete;
+
+        ~TempFile() {
+            std::error_code ignored;
+            std::filesystem::remove(file, ignored);
+        }
+
+        std::string path() const {
+            return file.string();
+        }
+
+        void write(const std::string& text) const {
+            std::ofstream(file, std::ios::binary) << text;
+        }
+    };
+
+    // The error `f()` throws, or the empty string if it throws none
+    template<typename F>
+    std::string error_of(F f) {
+        try {
+            f();
+        } catch (const std::exception& e) {
+            return e.what();
+        }
+        return "";
+    }
+
+    // Files are read in place, line by line, with blank lines and Windows
+    // line breaks allowed, and files that cannot be read are reported with
+    // the reason from the call that failed
+    std::size_t check_files() {
+        struct Case {
+            const char* name;
+            std::string text;
+            RSSystem::Verdict expected;
+        };
+        Case cases[] = {
+            {"file", "a -> b\n\nb -> a\n", RSSystem::Verdict::Tautology},
+            {"file without a final line break", "a ^ b\nc", RSSystem::Verdict::NotTautology},
+            {"file with Windows line breaks", "a ^ ~b\r\n\r\n~a v b\r\n", RSSystem::Verdict::Tautology},
+            // No formulas at all, so none of them is true
+            {"empty file", "", RSSystem::Verdict::NotTautology},
+        };
+        std::size_t count = 0;
+        for (const Case& c : cases) {
+            TempFile file("lines");
+            file.write(c.text);
+            mapped_file mapped(file.path().c_str());
+            RSSystem::Session session;
+            RSSystem::Result result = RSSystem::check_lines(session, mapped, RSSystem::Options());
+            if (result.verdict != c.expected)
+                fail(std::string(c.name) + " answered " + RSSystem::to_str(result.verdict), {c.text});
+            count++;
+        }
+
+        TempFile bad("bad");
+        bad.write("a v ~a\n(a v b\n");
+        std::string error = error_of([&]() {
+            mapped_file mapped(bad.path().c_str());
+            RSSystem::Session session;
+            RSSystem::check_lines(session, mapped, RSSystem::Options());
+        });
+        if (error != "Syntax Error: Extra Left Parenthesis")
+            fail("file with a syntax error gave \"" + error + "\"");
+
+        TempFile missing("missing");
+        error = error_of([&]() { mapped_file mapped(missing.path().c_str()); });
+        if (error != "Cannot open " + missing.path() + ": " + std::strerror(ENOENT))
+            fail("missing file gave \"" + error + "\"");
+        // A directory opens, but cannot be mapped
+        std::string directory = std::filesystem::temp_directory_path().string();
+        error = error_of([&]() { mapped_file mapped(directory.c_str()); });
+        if (error != "Cannot map " + directory + ": " + std::strerror(ENODEV))
+            fail("directory gave \"" + error + "\"");
+        return count + 3;
+    }
+
+    // Queries answered by several workers at once come back one per line
+    // in the order they were asked, errors and queries that reach their
+    // limits included
+    std::size_t check_batch() {
+        std::string big = "(a v ~a)";
+        for (std::size_t i = 1; i < 2000; i++)
+            big += " ^ (" + variable(i) + " v ~" + variable(i) + ")";
+        struct Query {
+            std::string text;
+            std::string answer;
+        };
+        Query kinds[] = {
+            {"a v ~a", "tautology"},
+            {"a -> b", "not tautology"},
+            {"(a v b", "error: Syntax Error: Extra Left Parenthesis"},
+            {"(a v $b)", "error: Unknown character '$' at index 5 of \"(a v $b)\"."},
+            {"~(a ^ ~a)", "tautology"},
+            {big, "unknown"},
+        };
+        std::string input;
+        std::vector<std::string> expected;
+        for (std::size_t i = 0; i < 600; i++) {
+            const Query& query = kinds[(i * 7) % std::size(kinds)];
+            input += query.text + "\n";
+            expected.push_back(query.answer);
+        }
+
+        TempFile queries("queries");
+        queries.write(input);
+        TempFile answers("answers");
+        int in = open(queries.path().c_str(), O_RDONLY);
+        int out = open(answers.path().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        Batch::Options options;
+        options.workers = 4;
+        options.check.engine = RSSystem::Engine::RS;
+        options.max_leaves = 1;
+        Batch::Statistics stats = Batch::serve(in, out, options);
+        close(in);
+        close(out);
+
+        if (stats.queries != expected.size())
+            fail("batch read " + std::to_string(stats.queries) + " queries");
+        std::ifstream written(answers.path(), std::ios::binary);
+        std::vector<std::string> got;
+        for (std::string line; std::getline(written, line); )
+            got.push_back(line);
+        for (std::size_t i = 0; i < std::max(got.size(), expected.size()); i++) {
+            std::string answer = i < got.size() ? got[i] : "nothing";
+            if (i >= expected.size() or answer != expected[i]) {
+                fail("batch answered query " + std::to_string(i + 1) + " with " + answer);
+                break;
+            }
+        }
+        return 1;
+    }
+
+    // Checks that `formula` is given up on, as unknown, for `reason`
+    void check_stops(const std::string& name, const std::string& formula, const RSSystem::Options& options, const RSSystem::Limits& limits, RSSystem::StopReason reason) {
+        std::string_view view = formula;
+        RSSystem::Session session;
+        RSSystem::Result result = RSSystem::check(session, std::span(&view, 1), options, limits);
+        if (result.verdict != RSSystem::Verdict::Unknown)
+            fail(name + " answered " + RSSystem::to_str(result.verdict));
+        else if (result.stopped != reason)
+            fail(name + " stopped for " + RSSystem::to_str(result.stopped) + " rather than " + RSSystem::to_str(reason));
+    }
+
+    // Each limit ends a check that would otherwise go on well past it. The
+    // formulas are tautologies, so no engine can end early by finding a
+    // counterexample.
+    std::size_t check_limits() {
+        // Thousands of branches, each closed after a few rule applications
+        std::string branches;
+        for (std::size_t i = 0; i < 2000; i++)
+            branches += (i > 0 ? " ^ (" : "(") + variable(i) + " v ~" + variable(i) + ")";
+        // Over a thousand blocks of assignments
+        std::string assignments;
+        for (std::size_t i = 0; i < 16; i++)
+            assignments += variable(i) + " v ";
+        assignments += "~" + variable(0);
+
+        std::size_t cases = 0;
+        for (unsigned threads : {1u, 4u}) {
+            std::string on = " on " + std::to_string(threads) + " threads";
+            RSSystem::Options rs;
+            rs.engine = RSSystem::Engine::RS;
+            rs.threads = threads;
+            RSSystem::Options truth_table;
+            truth_table.engine = RSSystem::Engine::TruthTable;
+            truth_table.threads = threads;
+
+            RSSystem::Limits budget;
+            budget.max_steps = 10;
+            check_stops("rs with a budget" + on, branches, rs, budget, RSSystem::StopReason::Budget);
+            check_stops("truth-table with a budget" + on, assignments, truth_table, budget, RSSystem::StopReason::Budget);
+
+            RSSystem::Limits leaves;
+            leaves.max_leaves = 1;
+            check_stops("rs with one leaf" + on, branches, rs, leaves, RSSystem::StopReason::Leaves);
+            cases += 3;
+        }
+
+        std::stop_source source;
+        source.request_stop();
+        RSSystem::Limits cancelled;
+        cancelled.stop = source.get_token();
+        RSSystem::Limits late;
+        late.deadline = std::chrono::steady_clock::now() - std::chrono::seconds(1);
+        for (const Setting& setting : settings()) {
+            check_stops(std::string(setting.name) + " when cancelled", branches, setting.options, cancelled, RSSystem::StopReason::Cancelled);
+            check_stops(std::string(setting.name) + " past its deadline", branches, setting.options, late, RSSystem::StopReason::Deadline);
+            cases += 2;
+        }
+        return cases;
+    }
+
+    // `are_equivalent` on pairs known to be equivalent or not, including
+    // formulas over different variables, and on text that does not parse
+    void check_equivalence() {
+        struct Case {
+            const char* a;
+            const char* b;
+            bool expected;
+        };
+        Case cases[] = {
+            {"a -> b", "~a v b", true},
+            {"~(a ^ b)", "~a v ~b", true},
+            {"a ^ (b v c)", "(a ^ b) v (a ^ c)", true},
+            {"a v ~a", "b -> b", true},
+            {"~~a", "a", true},
+            {"a -> b", "b -> a", false},
+            {"a", "b", false},
+            {"a ^ b", "a v b", false},
+            {"a v ~a", "b", false},
+        };
+        for (const Case& c : cases)
+            if (RSSystem::are_equivalent(c.a, c.b) != c.expected)
+                fail(std::string("are_equivalent answered ") + (c.expected ? "false" : "true"), {c.a, c.b});
+        try {
+            RSSystem::are_equivalent("(a v b", "a v b");
+            fail("are_equivalent accepted a syntax error");
+        } catch (const std::exception&) {
+        }
+    }
+}
+
+int main() {
+    std::size_t cases = 0;
+    for (std::uint64_t seed = 1; seed <= 1000; seed++) {
+        Generator generator(seed);
+        unsigned variables = 1 + generator.next(6);
+        std::vector<std::size_t> roots;
+        std::size_t formula = generator.formula(variables, 1 + generator.next(4));
+        roots.push_back(formula);
+        // A formula and the negation of an equivalent one make a
+        // tautology, which random formulas seldom are
+        if (generator.next(3) == 0) {
+            std::size_t rewritten = generator.rewrite(formula, false);
+            if (!RSSystem::are_equivalent(generator.text(formula), generator.text(rewritten)))
+                fail("are_equivalent answered false", {generator.text(formula), generator.text(rewritten)});
+            roots.push_back(generator.add({'~', 0, {rewritten}}));
+        } else if (generator.next(2) == 0)
+            roots.push_back(generator.formula(variables, 2));
+        check_case(generator, roots, variables);
+        cases++;
+    }
+    check_long_chains();
+    cases += 2;
+    check_equivalence();
+    cases += 10;
+    cases += check_limits();
+    cases += check_parallel_reading();
+    cases += check_files();
+    cases += check_batch();
+
+    std::cout << cases << " cases, " << failures << " failures" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
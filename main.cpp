@@ -1,11 +1,140 @@
 #include "rs-system.cpp"
+#include "batch.cpp"
 #include "timer.hpp"
 
+#include <chrono>
+#include <cstring>
+#include <exception>
 #include <iostream>
 #include <string>
 #include <vector>
 
-int main() {
+int main(int argc, char** argv) {
+    // Command line options:
+    //    -t N, --threads N  - explore the tree on N threads (0: one per core)
+    //    -q, --quiet        - do not print the leaves of the tree
+    //    -p, --preprocess   - simplify the formulas before deciding them
+    //    -e, --engine NAME  - decide the formula with `rs`, `truth-table`, `sat`
+    //                         or `bdd`,
+    //                         instead of picking automatically (only done
+    //                         when leaves are not printed)
+    //    -s, --schedule NAME - apply the RS rules `left` to right, or `alpha`
+    //                         rules before branching ones
+    //    --memo MB          - remember fundamental branches in up to MB
+    //                         megabytes (default: 0, do not remember them),
+    //                         only on one thread and with -q
+    //    --no-backjump      - explore second branches even when the first
+    //                         closed without the formula that split them
+    //    -f, --file PATH    - read the formulas from a file, one per line,
+    //                         instead of asking for them
+    //    --batch            - answer one query per line of stdin, each a
+    //                         formula, until the end of the input
+    //    --socket PATH      - answer queries the same way for each client
+    //                         of a Unix socket at PATH, serving clients at
+    //                         the same time
+    //    With --batch and --socket, -t is the number of queries decided at
+    //    the same time for each client (default: one per core), and the
+    //    answers are written in order, one per line.
+    //    --timeout SECONDS  - give up on the formula, or on each query, once
+    //                         SECONDS have passed
+    //    --budget N         - give up after N units of work: rule
+    //                         applications, assignments, conflicts or BDD
+    //                         nodes, depending on the engine
+    //    --max-leaves N     - give up after checking N leaves of the RS tree
+    RSSystem::Options options;
+    RSSystem::Limits limits;
+    double timeout = 0;
+    bool threads_set = false;
+    const char* path = nullptr;
+    bool batch = false;
+    const char* socket_path = nullptr;
+    options.print_leaves = true;
+    for (int i = 1; i < argc; i++) {
+        if ((!std::strcmp(argv[i], "-t") or !std::strcmp(argv[i], "--threads")) and i+1 < argc) {
+            options.threads = std::stoi(argv[++i]);
+            threads_set = true;
+        } else if (!std::strcmp(argv[i], "-p") or !std::strcmp(argv[i], "--preprocess")) {
+            options.preprocess = true;
+        } else if (!std::strcmp(argv[i], "-q") or !std::strcmp(argv[i], "--quiet")) {
+            options.print_leaves = false;
+        } else if ((!std::strcmp(argv[i], "-e") or !std::strcmp(argv[i], "--engine")) and i+1 < argc) {
+            std::string name = argv[++i];
+            if (name == "rs")
+                options.engine = RSSystem::Engine::RS;
+            else if (name == "truth-table")
+                options.engine = RSSystem::Engine::TruthTable;
+            else if (name == "sat")
+                options.engine = RSSystem::Engine::SAT;
+            else if (name == "bdd")
+                options.engine = RSSystem::Engine::BDD;
+            else if (name == "auto")
+                options.engine = RSSystem::Engine::Auto;
+            else {
+                std::cerr << "Unknown engine: " << name << std::endl;
+                return 1;
+            }
+        } else if ((!std::strcmp(argv[i], "-s") or !std::strcmp(argv[i], "--schedule")) and i+1 < argc) {
+            std::string name = argv[++i];
+            if (name == "left")
+                options.schedule = RSSystem::Schedule::LeftToRight;
+            else if (name == "alpha")
+                options.schedule = RSSystem::Schedule::AlphaFirst;
+            else {
+                std::cerr << "Unknown schedule: " << name << std::endl;
+                return 1;
+            }
+        } else if (!std::strcmp(argv[i], "--memo") and i+1 < argc) {
+            options.memo_bytes = std::stoull(argv[++i]) << 20;
+        } else if (!std::strcmp(argv[i], "--no-backjump")) {
+            options.backjump = false;
+        } else if ((!std::strcmp(argv[i], "-f") or !std::strcmp(argv[i], "--file")) and i+1 < argc) {
+            path = argv[++i];
+        } else if (!std::strcmp(argv[i], "--batch")) {
+            batch = true;
+        } else if (!std::strcmp(argv[i], "--socket") and i+1 < argc) {
+            socket_path = argv[++i];
+        } else if (!std::strcmp(argv[i], "--timeout") and i+1 < argc) {
+            timeout = std::stod(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--budget") and i+1 < argc) {
+            limits.max_steps = std::stoull(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--max-leaves") and i+1 < argc) {
+            limits.max_leaves = std::stoull(argv[++i]);
+        } else {
+            std::cerr << "Unknown option: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    // Queries in batch mode are each decided on one thread without printing
+    // leaves, so the memo is only lost when a single check is split between
+    // threads or prints its leaves
+    if (options.memo_bytes != 0 and !batch and socket_path == nullptr) {
+        if (options.threads != 1)
+            std::cerr << "Warning: --memo is only used on one thread, and is ignored with -t "
+                      << options.threads << std::endl;
+        if (options.print_leaves)
+            std::cerr << "Warning: --memo is only used when leaves are not printed, and is ignored without -q"
+                      << std::endl;
+    }
+
+    if (batch or socket_path != nullptr) {
+        Batch::Options batch_options;
+        if (threads_set)
+            batch_options.workers = options.threads;
+        batch_options.check = options;
+        batch_options.timeout = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(timeout));
+        batch_options.max_steps = limits.max_steps;
+        batch_options.max_leaves = limits.max_leaves;
+        if (socket_path != nullptr) {
+            Batch::serve_socket(socket_path, batch_options, std::cerr);
+        } else {
+            Batch::Statistics stats = Batch::serve(0, 1, batch_options);
+            std::cerr << "Answered " << stats.queries << " queries in " << stats.seconds << " s ("
+                      << stats.queries_per_second() << " queries/s)" << std::endl;
+        }
+        return 0;
+    }
+
     // The vector below contains the formula(s) to handle, written in infix
     // notation. Having more than 1 formula is equivalent to connecting all
     // of the formulas by `v`.
@@ -25,26 +154,80 @@ int main() {
     //    "a -> (b -> c)".
 
     std::vector<std::string> formulas;
-    std::string response;
-    std::cout << "How many formulas: ";
-    std::getline(std::cin, response);
-    int n = std::stoi(response);
-    for (int i = 0; i < n; i++) {
-        std::cout << "Formula #" << (i+1) << ": ";
+    if (path == nullptr) {
+        std::string response;
+        std::cout << "How many formulas: ";
         std::getline(std::cin, response);
-        formulas.push_back(response);
+        int n = std::stoi(response);
+        for (int i = 0; i < n; i++) {
+            std::cout << "Formula #" << (i+1) << ": ";
+            std::getline(std::cin, response);
+            formulas.push_back(response);
+        }
     }
 
     timer t;
-    // First argument is an iterable of strings containing the formulas
-    // Second argument (option) is whether or not to print the leaves (default: false)
-    bool is_tautology = RSSystem::is_tautology(formulas, true);
+    if (timeout > 0)
+        limits.deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(timeout));
+    // `check` takes the formulas as strings, the `RSSystem::Options` with
+    // the settings, and optionally `RSSystem::Limits` on how long it may
+    // take. `RSSystem::is_tautology` does the same without limits, and
+    // answers with a bool.
+    RSSystem::Session session;
+    RSSystem::Result result;
+    try {
+        if (path != nullptr) {
+            // The file is parsed where it is mapped, so its text is never
+            // copied into the process
+            mapped_file file(path);
+            result = RSSystem::check_lines(session, file, options, limits);
+        } else {
+            std::vector<std::string_view> views(formulas.begin(), formulas.end());
+            result = RSSystem::check(session, views, options, limits);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
     double time = t.get_time();
+    const RSSystem::Statistics& stats = result.stats;
 
-    if (is_tautology)
+    if (result.verdict == RSSystem::Verdict::Tautology) {
         std::cout << "Formula is a tautology!" << std::endl;
-    else
+    } else if (result.verdict == RSSystem::Verdict::NotTautology) {
         std::cout << "Formula is NOT a tautology!" << std::endl;
+        std::cout << "Counterexample: " << RSSystem::to_str(session.symbols, result.counterexample) << std::endl;
+    } else {
+        std::cout << "Gave up on the formula (" << RSSystem::to_str(result.stopped) << " reached)" << std::endl;
+    }
 
     std::cout << "Time: " << time << std::endl;
+    std::cout << "Formula nodes: " << stats.formula_nodes << " (" << stats.formula_bytes << " bytes, "
+              << stats.formula_chunks << " heap allocations, "
+              << stats.formula_pool_bytes << " bytes as arrays)" << std::endl;
+    std::cout << "Created while decomposing: " << stats.decomposition_nodes << " nodes, "
+              << stats.decomposition_chunks << " heap allocations" << std::endl;
+    if (options.preprocess)
+        std::cout << "Preprocessing: " << stats.preprocess_nodes_before << " -> " << stats.preprocess_nodes_after
+                  << " nodes, tree size " << stats.preprocess_size_before << " -> " << stats.preprocess_size_after << std::endl;
+    std::cout << "Engine: " << RSSystem::to_str(stats.engine) << std::endl;
+    if (stats.engine == RSSystem::Engine::TruthTable) {
+        std::cout << "Assignments: " << stats.assignments << std::endl;
+    } else if (stats.engine == RSSystem::Engine::BDD) {
+        std::cout << "BDD nodes: " << stats.bdd_nodes << " (" << stats.bdd_bytes << " bytes)" << std::endl;
+    } else if (stats.engine == RSSystem::Engine::SAT) {
+        std::cout << "Conflicts: " << stats.conflicts << ", decisions: " << stats.decisions << std::endl;
+    } else {
+        std::cout << "Leaves: " << stats.leaves;
+        if (options.threads != 1 and options.backjump)
+            std::cout << " (" << stats.steals << " branches stolen, " << stats.pruned << " subtrees pruned)";
+        else if (options.threads != 1)
+            std::cout << " (" << stats.steals << " branches stolen)";
+        else if (options.backjump)
+            std::cout << " (" << stats.pruned << " subtrees pruned)";
+        std::cout << std::endl;
+        if (options.threads == 1 and options.memo_bytes != 0 and !options.print_leaves)
+            std::cout << "Memo: " << stats.memo_hits << " hits, " << stats.memo_entries << " entries, "
+                      << stats.memo_evictions << " evicted" << std::endl;
+    }
 }
@@ -0,0 +1,80 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A file mapped read-only into memory, for reading large inputs in place.
+// Pages are read from the file on first touch, and the kernel is told to
+// expect a scan from start to end, so that it reads ahead. Parts that have
+// been read can be handed back with `release`, so that a file larger than
+// memory can be scanned with only a window of it resident.
+class mapped_file {
+    const char* data = nullptr;
+    std::size_t length = 0;
+
+    // `error` is the errno of the call that failed, saved before anything
+    // else, such as closing the file, can change it
+    [[noreturn]] static void fail(const char* what, const char* path, int error) {
+        throw std::runtime_error(std::string("Cannot ") + what + " " + path + ": " + std::strerror(error));
+    }
+
+public:
+    explicit mapped_file(const char* path) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            fail("open", path, errno);
+        struct stat info;
+        if (fstat(fd, &info) < 0) {
+            int error = errno;
+            close(fd);
+            fail("read", path, error);
+        }
+        length = info.st_size;
+        // An empty file cannot be mapped, and has nothing to map anyway
+        if (length > 0) {
+            void* address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address == MAP_FAILED) {
+                int error = errno;
+                close(fd);
+                fail("map", path, error);
+            }
+            data = (const char*)address;
+            madvise(address, length, MADV_SEQUENTIAL);
+        }
+        close(fd);
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    ~mapped_file() {
+        if (data != nullptr)
+            munmap((void*)data, length);
+    }
+
+    std::string_view text() const {
+        return std::string_view(data, length);
+    }
+
+    // Drops the pages that lie wholly within `part` of the text. They are
+    // read from the file again if touched later.
+    void release(std::string_view part) const {
+        std::size_t page = sysconf(_SC_PAGESIZE);
+        std::size_t begin = (std::size_t)(part.data() - data + page - 1) / page * page;
+        std::size_t end = (std::size_t)(part.data() + part.size() - data) / page * page;
+        if (begin < end)
+            madvise((void*)(data + begin), end - begin, MADV_DONTNEED);
+    }
+};
+
+#endif
@@ -1,32 +1,46 @@
 #ifndef PARSER_PARSE_CPP
 #define PARSER_PARSE_CPP
 
+#include <algorithm>
+#include <climits>
+#include <cstdint>
 #include <vector>
 #include <exception>
+#include <span>
 #include <iostream>
 #include <string>
-#include <sstream>
+#include <string_view>
 
 #include "token.cpp"
+#include "tokenizer.cpp"
+#include "arena.hpp"
 
 namespace Parser {
     using Tokenizer::Token;
+    using Tokenizer::SymbolTable;
 
     struct FormulaFactory;
 
     enum FormulaType {
         Atom,
         Unary,
-        Binary
+        Binary,
+        Nary
     };
 
+    // A formula node, with pointers to its operands. Formulas are
+    // hash-consed by their factory, so structurally equal formulas are the
+    // same node and can be compared by pointer. `id` numbers the nodes of a
+    // factory densely in creation order, and indexes everything else known
+    // about a node, such as its size and negation, in the factory's pool.
     struct Formula {
         friend FormulaFactory;
         const FormulaType type;
         Token token;
+        unsigned id;
 
     protected:
-        Formula(Token token, FormulaType type) : token(token), type(type) {}
+        Formula(Token token, FormulaType type) : type(type), token(token) {}
 
     private:
         Formula(Token token) : Formula(token, FormulaType::Atom) {}
@@ -34,221 +48,496 @@ namespace Parser {
 
     struct UnaryFormula : Formula {
         friend FormulaFactory;
-        Formula* right;
+        Formula* const right;
 
     private:
-        UnaryFormula(Token token) : Formula(token, FormulaType::Unary), right(nullptr) {}
+        UnaryFormula(Token token, Formula* right) : Formula(token, FormulaType::Unary), right(right) {}
     };
 
     struct BinaryFormula : Formula {
         friend FormulaFactory;
-        Formula* right;
-        Formula* left;
+        Formula* const right;
+        Formula* const left;
 
     private:
-        BinaryFormula(Token token) : Formula(token, FormulaType::Binary), right(nullptr), left(nullptr) {}
+        BinaryFormula(Token token, Formula* left, Formula* right) : Formula(token, FormulaType::Binary), right(right), left(left) {}
     };
 
-    struct FormulaFactory {
-        static Formula* makeFormula(Token token) {
-            return new Formula(token);
-        }
+    // An AND or OR of three or more operands, kept in one array. Runs of
+    // the same connective, like `a v b v c`, are parsed into one of these.
+    struct NaryFormula : Formula {
+        friend FormulaFactory;
+        const unsigned arity;
+        Formula* const* const operands;
 
-        static UnaryFormula* makeUnaryFormula(Token token) {
-            return new UnaryFormula(token);
+        Formula* const* begin() const {
+            return operands;
         }
 
-        static BinaryFormula* makeBinaryFormula(Token token) {
-            return new BinaryFormula(token);
+        Formula* const* end() const {
+            return operands + arity;
         }
+
+    private:
+        NaryFormula(Token token, unsigned arity, Formula* const* operands) : Formula(token, FormulaType::Nary), arity(arity), operands(operands) {}
     };
 
-    std::string __to_str_formula(Parser::Formula* formula, Token parent) {
-        std::stringstream ss;
-        switch (formula->type) {
-            case Parser::FormulaType::Atom:
-                ss << formula->token.name();
-                break;
-            case Parser::FormulaType::Unary: {
-                auto op = (Parser::UnaryFormula*)formula;
-                ss << op->token.name();
-                bool bigterm = op->right->type != Parser::FormulaType::Atom; 
-                if (bigterm)
-                    ss << '(';
-                ss << __to_str_formula(op->right, op->token);
-                if (bigterm)
-                    ss << ')';
-                break;
-            }
-            case Parser::FormulaType::Binary: {
-                auto op = (Parser::BinaryFormula*)formula;
-                bool unwrapable = op->token == Token::Or or op->token == Token::And;
-                bool unwrap = unwrapable and op->token == parent;
-                if (!unwrap)
-                    ss << '(';
-                ss << __to_str_formula(op->left, op->token);
-                ss << op->token.name();
-                ss << __to_str_formula(op->right, op->token);
-                if (!unwrap)
-                    ss << ')';
-                break;
+    // Index of a formula node within its factory, the node's `id`
+    using NodeId = std::uint32_t;
+    constexpr NodeId no_node = UINT32_MAX;
+
+    // The nodes of a factory as parallel arrays indexed by id, for code that
+    // walks the same formulas over and over. A binary node's operands are
+    // `left` and `right`, and a unary node's is `right`. An n-ary node keeps
+    // its operands in one array, from offset `left`, and its arity in
+    // `right`. Nodes only refer to nodes made before them, so the arrays
+    // describe whole formulas and can be copied or written out as they are.
+    class FormulaPool {
+        friend FormulaFactory;
+        std::vector<std::uint8_t> kinds;
+        std::vector<Token> tokens;
+        std::vector<NodeId> lefts;
+        std::vector<NodeId> rights;
+        std::vector<NodeId> operand_ids;
+        // Number of nodes in each formula written out as a tree, saturating
+        // rather than overflowing
+        std::vector<unsigned> sizes;
+        // The node for `~id`, once the factory has built it
+        std::vector<NodeId> negations;
+
+        void add(Formula* formula, std::span<Formula* const> operands, unsigned size) {
+            FormulaType type = formula->type;
+            NodeId left = no_node;
+            NodeId right = no_node;
+            if (type == FormulaType::Unary) {
+                right = operands[0]->id;
+            } else if (type == FormulaType::Binary) {
+                left = operands[0]->id;
+                right = operands[1]->id;
+            } else if (type == FormulaType::Nary) {
+                left = operand_ids.size();
+                right = operands.size();
+                for (auto operand : operands)
+                    operand_ids.push_back(operand->id);
             }
+            kinds.push_back(type);
+            tokens.push_back(formula->token);
+            lefts.push_back(left);
+            rights.push_back(right);
+            sizes.push_back(size);
+            negations.push_back(no_node);
         }
-        return ss.str();
-    }
 
-    std::string to_str(Parser::Formula* formula) {
-        if (formula == nullptr)
-            return "";
-        std::stringstream ss;
-        switch (formula->type) {
-            case Parser::FormulaType::Atom:
-                ss << formula->token.name();
-                break;
-            case Parser::FormulaType::Unary: {
-                auto op = (Parser::UnaryFormula*)formula;
-                ss << op->token.name();
-                ss << __to_str_formula(op->right, op->token);
-                break;
-            }
-            case Parser::FormulaType::Binary: {
-                auto op = (Parser::BinaryFormula*)formula;
-                ss << __to_str_formula(op->left, op->token);
-                ss << op->token.name();
-                ss << __to_str_formula(op->right, op->token);
-                break;
+    public:
+        FormulaType kind(NodeId id) const {
+            return (FormulaType)kinds[id];
+        }
+
+        Token token(NodeId id) const {
+            return tokens[id];
+        }
+
+        NodeId left(NodeId id) const {
+            return lefts[id];
+        }
+
+        NodeId right(NodeId id) const {
+            return rights[id];
+        }
+
+        std::span<const NodeId> operands(NodeId id) const {
+            return {operand_ids.data() + lefts[id], rights[id]};
+        }
+
+        unsigned tree_size(NodeId id) const {
+            return sizes[id];
+        }
+
+        // The node equivalent to `~id`: the operand of a negation, and
+        // otherwise the negation made by the factory, or `no_node` if it
+        // has not been made
+        NodeId negation(NodeId id) const {
+            if (kinds[id] == FormulaType::Unary and tokens[id] == Token::Not)
+                return rights[id];
+            return negations[id];
+        }
+
+        unsigned size() const {
+            return kinds.size();
+        }
+
+        // Bytes taken up by the arrays' contents
+        std::size_t bytes() const {
+            return kinds.size() * (sizeof(std::uint8_t) + sizeof(Token) + 3 * sizeof(NodeId) + sizeof(unsigned))
+                 + operand_ids.size() * sizeof(NodeId);
+        }
+    };
+
+    // Owns every formula node it creates. Nodes are bump allocated from an
+    // arena and are all freed together when the factory is destroyed.
+    //
+    // Every node goes through a unique table first, so asking for a formula
+    // that already exists returns the existing node instead of a copy.
+    // Every node is also added to the factory's pool, under its id, which
+    // keeps all there is to a node beyond its structure.
+    struct FormulaFactory {
+        arena nodes;
+
+    private:
+        FormulaPool formula_pool;
+        // The node for each id
+        std::vector<Formula*> by_id;
+        // Open addressing table of all nodes, sized to a power of two. A
+        // slot holds a node's id in its low half and 32 bits of its hash,
+        // which also place it in the table, in its high half, so that most
+        // mismatches are told apart without reading the node.
+        static constexpr std::uint64_t empty = UINT64_MAX;
+        std::vector<std::uint64_t> table = std::vector<std::uint64_t>(1 << 10, empty);
+        unsigned num_nodes = 0;
+        unsigned variables = 0;
+
+        static std::size_t mix(std::size_t h, std::size_t v) {
+            h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+            return h;
+        }
+
+        // Spreads a hash over all its bits. Operands have consecutive ids,
+        // which `mix` alone turns into runs of nearby hashes, and runs in
+        // the low bits the table is indexed by make long probe sequences.
+        static std::size_t finish(std::size_t h) {
+            h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+            h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+            return h ^ (h >> 31);
+        }
+
+        static bool matches(Formula* formula, FormulaType type, Token token, std::span<Formula* const> operands) {
+            if (formula->type != type or !(formula->token == token))
+                return false;
+            switch (type) {
+                case FormulaType::Atom:
+                    return true;
+                case FormulaType::Unary:
+                    return ((UnaryFormula*)formula)->right == operands[0];
+                case FormulaType::Binary:
+                    return ((BinaryFormula*)formula)->left == operands[0] and ((BinaryFormula*)formula)->right == operands[1];
+                case FormulaType::Nary: {
+                    auto op = (NaryFormula*)formula;
+                    return op->arity == operands.size() and std::equal(operands.begin(), operands.end(), op->begin());
+                }
             }
+            return false;
         }
-        return ss.str();
-    }
 
-    std::string to_str(std::vector<Formula*> formulas) {
-        std::stringstream ss;
-        ss << '[';
-        if (formulas.size() > 0) {
-            ss << to_str(formulas[0]);
-            for (int i = 1; i < formulas.size(); i++) {
-                ss << ", ";
-                ss << to_str(formulas[i]);
+        void grow() {
+            std::vector<std::uint64_t> old(table.size() << 1, empty);
+            old.swap(table);
+            std::size_t mask = table.size() - 1;
+            for (auto entry : old) {
+                if (entry == empty)
+                    continue;
+                std::size_t slot = (entry >> 32) & mask;
+                while (table[slot] != empty)
+                    slot = (slot + 1) & mask;
+                table[slot] = entry;
             }
         }
-        ss << ']';
-        return ss.str();
-    }
 
-    std::string to_str(std::list<Formula*> formulas) {
-        std::stringstream ss;
-        ss << '[';
-        auto it = formulas.begin();
-        if (it != formulas.end()) {
-            ss << to_str(*it);
-            while (++it != formulas.end()) {
-                ss << ", ";
-                ss << to_str(*it);
+        // Returns the node for (type, token, operands), creating it with
+        // `make` if it does not exist yet
+        template<typename Make>
+        Formula* intern(FormulaType type, Token token, std::span<Formula* const> operands, Make make) {
+            std::size_t hash = mix(type, token.value());
+            for (auto operand : operands)
+                hash = mix(hash, operand->id);
+            std::uint64_t tag = finish(hash) & 0xffffffff;
+            std::size_t mask = table.size() - 1;
+            std::size_t slot = tag & mask;
+            while (table[slot] != empty) {
+                if (table[slot] >> 32 == tag) {
+                    Formula* formula = by_id[(NodeId)table[slot]];
+                    if (matches(formula, type, token, operands))
+                        return formula;
+                }
+                slot = (slot + 1) & mask;
             }
+            Formula* formula = make();
+            formula->id = num_nodes++;
+            std::uint64_t size = 1;
+            for (auto operand : operands)
+                size += formula_pool.sizes[operand->id];
+            formula_pool.add(formula, operands, (unsigned)std::min<std::uint64_t>(size, UINT_MAX));
+            by_id.push_back(formula);
+            table[slot] = tag << 32 | formula->id;
+            if (2 * num_nodes > table.size())
+                grow();
+            return formula;
+        }
+
+    public:
+        Formula* makeFormula(Token token) {
+            variables = std::max<unsigned>(variables, token.id() + 1);
+            return intern(FormulaType::Atom, token, {}, [&]() {
+                return new (nodes.allocate(sizeof(Formula), alignof(Formula))) Formula(token);
+            });
         }
-        ss << ']';
-        return ss.str();
-    }
 
-    Formula* parse(std::vector<Token> tokens) {
-        std::vector<Token> symbol_stack;
-        std::vector<Formula*> formula_stack;
-        for (auto token : tokens) {
-            if (token.is_variable()) {
-                formula_stack.push_back(FormulaFactory::makeFormula(token)); 
+        UnaryFormula* makeUnaryFormula(Token token, Formula* right) {
+            Formula* operands[] = {right};
+            auto formula = intern(FormulaType::Unary, token, operands, [&]() {
+                return new (nodes.allocate(sizeof(UnaryFormula), alignof(UnaryFormula))) UnaryFormula(token, right);
+            });
+            if (token == Token::Not)
+                formula_pool.negations[right->id] = formula->id;
+            return (UnaryFormula*)formula;
+        }
+
+        BinaryFormula* makeBinaryFormula(Token token, Formula* left, Formula* right) {
+            Formula* operands[] = {left, right};
+            return (BinaryFormula*)intern(FormulaType::Binary, token, operands, [&]() {
+                return new (nodes.allocate(sizeof(BinaryFormula), alignof(BinaryFormula))) BinaryFormula(token, left, right);
+            });
+        }
+
+        // Returns `operands[0] token operands[1] token ...` for an AND or
+        // OR: an n-ary formula for three or more operands, and a binary
+        // formula or the operand itself for fewer
+        Formula* makeNaryFormula(Token token, std::span<Formula* const> operands) {
+            if (operands.size() == 1)
+                return operands[0];
+            if (operands.size() == 2)
+                return makeBinaryFormula(token, operands[0], operands[1]);
+            return intern(FormulaType::Nary, token, operands, [&]() {
+                auto array = (Formula**)nodes.allocate(operands.size() * sizeof(Formula*), alignof(Formula*));
+                std::copy(operands.begin(), operands.end(), array);
+                return new (nodes.allocate(sizeof(NaryFormula), alignof(NaryFormula))) NaryFormula(token, operands.size(), array);
+            });
+        }
+
+        // Returns a formula equivalent to `~formula`. Double negations are
+        // cancelled rather than built, and each node's negation is
+        // remembered so it is only looked up once.
+        Formula* makeNegation(Formula* formula) {
+            if (formula->type == FormulaType::Unary and formula->token == Token::Not)
+                return ((UnaryFormula*)formula)->right;
+            NodeId negation = formula_pool.negations[formula->id];
+            if (negation != no_node)
+                return by_id[negation];
+            return makeUnaryFormula(Token::Not, formula);
+        }
+
+        // Number of distinct formulas created so far
+        unsigned size() const {
+            return num_nodes;
+        }
+
+        // One more than the highest variable id among the atoms, so the
+        // variables of the formulas can be used to index arrays
+        unsigned num_variables() const {
+            return variables;
+        }
+
+        const FormulaPool& pool() const {
+            return formula_pool;
+        }
+
+        Formula* node(NodeId id) const {
+            return by_id[id];
+        }
+    };
+
+    // Appends `id` to `out`, written in infix. Operands that are not
+    // variables get parentheses, except for the formula itself and for
+    // operands of an AND or OR with the same connective. Formulas are
+    // walked with an explicit stack, so deep ones cannot overflow the call
+    // stack, and nothing is copied on the way up.
+    void print(const SymbolTable& symbols, const FormulaPool& pool, NodeId id, std::string& out) {
+        if (id == no_node)
+            return;
+        // Either a node to print, with the connective it is an operand
+        // of, or text when `id` is `no_node`
+        struct Item {
+            NodeId id;
+            Token parent;
+            bool top;
+            std::string_view text;
+        };
+        std::vector<Item> stack{{id, Token::LParen, true, {}}};
+        while (!stack.empty()) {
+            Item item = stack.back();
+            stack.pop_back();
+            if (item.id == no_node) {
+                out += item.text;
                 continue;
             }
-            if (token == Token::RParen) {
-                while (symbol_stack.size() > 0 and symbol_stack.back() != Token::LParen) {
-                    Token symbol = symbol_stack.back();
-                    symbol_stack.pop_back();
-
-                    int operands = (symbol == Token::Not) ? 1 : 2;
-                    if (formula_stack.size() < operands)
-                        throw std::runtime_error("Syntax Error: Not Enough Operands");
-
-                    Formula* right = formula_stack.back();
-                    formula_stack.pop_back();
-                    if (operands == 1) {
-                        UnaryFormula* op = FormulaFactory::makeUnaryFormula(symbol);
-                        op->right = right;
-                        formula_stack.push_back(op);
-                    } else {
-                        Formula* left = formula_stack.back();
-                        formula_stack.pop_back();
-                        BinaryFormula* op = FormulaFactory::makeBinaryFormula(symbol);
-                        op->right = right;
-                        op->left = left;
-                        formula_stack.push_back(op);
+            Token token = pool.token(item.id);
+            std::string_view name = symbols.name(token);
+            switch (pool.kind(item.id)) {
+                case FormulaType::Atom:
+                    out += name;
+                    break;
+                case FormulaType::Unary: {
+                    NodeId right = pool.right(item.id);
+                    bool bigterm = !item.top and pool.kind(right) != FormulaType::Atom;
+                    out += name;
+                    if (bigterm) {
+                        out += '(';
+                        stack.push_back({no_node, token, false, ")"});
                     }
+                    stack.push_back({right, token, false, {}});
+                    break;
+                }
+                case FormulaType::Binary: {
+                    bool unwrapable = token == Token::Or or token == Token::And;
+                    bool wrap = !item.top and !(unwrapable and token == item.parent);
+                    if (wrap) {
+                        out += '(';
+                        stack.push_back({no_node, token, false, ")"});
+                    }
+                    stack.push_back({pool.right(item.id), token, false, {}});
+                    stack.push_back({no_node, token, false, name});
+                    stack.push_back({pool.left(item.id), token, false, {}});
+                    break;
+                }
+                case FormulaType::Nary: {
+                    bool wrap = !item.top and token != item.parent;
+                    if (wrap) {
+                        out += '(';
+                        stack.push_back({no_node, token, false, ")"});
+                    }
+                    auto operands = pool.operands(item.id);
+                    for (std::size_t i = operands.size(); i-- > 0;) {
+                        stack.push_back({operands[i], token, false, {}});
+                        if (i > 0)
+                            stack.push_back({no_node, token, false, name});
+                    }
+                    break;
                 }
-                if (symbol_stack.size() == 0)
-                    throw std::runtime_error("Syntax Error: Extra Right Parenthesis");
-                symbol_stack.pop_back();
-                continue;
             }
-            int precedence = token.precedence();
-            // Deal with precedence
-            while(symbol_stack.size() > 0 
-                    and symbol_stack.back() != Token::LParen 
-                    and precedence < symbol_stack.back().precedence()){
-                Token symbol = symbol_stack.back();
+        }
+    }
+
+    // Appends `[a, b, ...]` to `out`
+    void print(const SymbolTable& symbols, const FormulaPool& pool, std::span<const NodeId> formulas, std::string& out) {
+        out += '[';
+        for (std::size_t i = 0; i < formulas.size(); i++) {
+            if (i > 0)
+                out += ", ";
+            print(symbols, pool, formulas[i], out);
+        }
+        out += ']';
+    }
+
+    std::string to_str(const SymbolTable& symbols, const FormulaPool& pool, NodeId id) {
+        std::string out;
+        print(symbols, pool, id, out);
+        return out;
+    }
+
+    std::string to_str(const SymbolTable& symbols, const FormulaFactory& factory, Formula* formula) {
+        if (formula == nullptr)
+            return "";
+        return to_str(symbols, factory.pool(), formula->id);
+    }
+
+    std::string to_str(const SymbolTable& symbols, const FormulaPool& pool, const std::vector<NodeId>& formulas) {
+        std::string out;
+        print(symbols, pool, formulas, out);
+        return out;
+    }
+
+    // Applies the operator on top of `symbol_stack` to the formulas on top
+    // of `formula_stack`. A run of the same AND or OR is applied all at
+    // once, as a single n-ary formula.
+    void reduce(std::vector<Token>& symbol_stack, std::vector<Formula*>& formula_stack, FormulaFactory& factory) {
+        Token symbol = symbol_stack.back();
+        symbol_stack.pop_back();
+
+        std::size_t operands = (symbol == Token::Not) ? 1 : 2;
+        if (symbol == Token::And or symbol == Token::Or) {
+            while (symbol_stack.size() > 0 and symbol_stack.back() == symbol) {
                 symbol_stack.pop_back();
+                operands++;
+            }
+        }
+        if (formula_stack.size() < operands)
+            throw std::runtime_error("Syntax Error: Not Enough Operands");
 
-                int operands = (symbol == Token::Not) ? 1 : 2;
-                if (formula_stack.size() < operands)
-                    throw std::runtime_error("Syntax Error: Not Enough Operands");
-
-                Formula* right = formula_stack.back();
-                formula_stack.pop_back();
-                if (operands == 1) {
-                    UnaryFormula* op = FormulaFactory::makeUnaryFormula(symbol);
-                    op->right = right;
-                    formula_stack.push_back(op);
-                } else {
-                    Formula* left = formula_stack.back();
-                    formula_stack.pop_back();
-                    BinaryFormula* op = FormulaFactory::makeBinaryFormula(symbol);
-                    op->right = right;
-                    op->left = left;
-                    formula_stack.push_back(op);
+        Formula* formula;
+        if (operands == 1)
+            formula = factory.makeUnaryFormula(symbol, formula_stack.back());
+        else if (operands == 2)
+            formula = factory.makeBinaryFormula(symbol, formula_stack.end()[-2], formula_stack.back());
+        else
+            formula = factory.makeNaryFormula(symbol, std::span<Formula* const>(formula_stack).last(operands));
+        formula_stack.resize(formula_stack.size() - operands);
+        formula_stack.push_back(formula);
+    }
+
+    namespace {
+        // Builds the formula made of the tokens that `next` reads, one at a
+        // time, with the shunting-yard algorithm. Operators wait on a stack
+        // until one of lower precedence, a closing parenthesis or the end
+        // comes, so nothing is recursive and each token is handled once,
+        // however deeply the formula nests.
+        template<typename Next>
+        Formula* parse_tokens(Next next, FormulaFactory& factory) {
+            std::vector<Token> symbol_stack;
+            std::vector<Formula*> formula_stack;
+            Token token = Token::LParen;
+            while (next(token)) {
+                if (token.is_variable()) {
+                    formula_stack.push_back(factory.makeFormula(token));
+                    continue;
                 }
+                if (token == Token::RParen) {
+                    while (symbol_stack.size() > 0 and symbol_stack.back() != Token::LParen)
+                        reduce(symbol_stack, formula_stack, factory);
+                    if (symbol_stack.size() == 0)
+                        throw std::runtime_error("Syntax Error: Extra Right Parenthesis");
+                    symbol_stack.pop_back();
+                    continue;
+                }
+                unsigned precedence = token.precedence();
+                // Deal with precedence
+                while (symbol_stack.size() > 0
+                        and symbol_stack.back() != Token::LParen
+                        and precedence < symbol_stack.back().precedence()) {
+                    reduce(symbol_stack, formula_stack, factory);
+                }
+                symbol_stack.push_back(token);
             }
-            symbol_stack.push_back(token);
-        }
-        while (symbol_stack.size() > 0 and symbol_stack.back() != Token::LParen) {
-            Token symbol = symbol_stack.back();
-            symbol_stack.pop_back();
-
-            int operands = (symbol == Token::Not) ? 1 : 2;
-            if (formula_stack.size() < operands)
-                throw std::runtime_error("Syntax Error: Not Enough Operands");
-
-            Formula* right = formula_stack.back();
-            formula_stack.pop_back();
-            if (operands == 1) {
-                UnaryFormula* op = FormulaFactory::makeUnaryFormula(symbol);
-                op->right = right;
-                formula_stack.push_back(op);
-            } else {
-                Formula* left = formula_stack.back();
-                formula_stack.pop_back();
-                BinaryFormula* op = FormulaFactory::makeBinaryFormula(symbol);
-                op->right = right;
-                op->left = left;
-                formula_stack.push_back(op);
-            }
+            while (symbol_stack.size() > 0 and symbol_stack.back() != Token::LParen)
+                reduce(symbol_stack, formula_stack, factory);
+            if (symbol_stack.size() > 0)
+                throw std::runtime_error("Syntax Error: Extra Left Parenthesis");
+            if (formula_stack.size() > 1)
+                throw std::runtime_error("Syntax Error: Too Many Operands");
+            if (formula_stack.size() == 0)
+                return nullptr;
+            return formula_stack.back();
         }
-        if (symbol_stack.size() > 0)
-            throw std::runtime_error("Syntax Error: Extra Left Parenthesis");
-        if (formula_stack.size() > 1)
-            throw std::runtime_error("Syntax Error: Too Many Operands");
-        if (formula_stack.size() == 0)
-            return nullptr;
-        return formula_stack.back();
     }
 
+    // Builds the formula for `tokens` in `factory`, or returns null if
+    // there are none
+    Formula* parse(std::span<const Token> tokens, FormulaFactory& factory) {
+        auto it = tokens.begin();
+        return parse_tokens([&](Token& token) {
+            if (it == tokens.end())
+                return false;
+            token = *it++;
+            return true;
+        }, factory);
+    }
+
+    // Builds the formula written in `s` in `factory`, reading its tokens
+    // as they are needed rather than tokenizing `s` first
+    Formula* parse(std::string_view s, SymbolTable& symbols, FormulaFactory& factory) {
+        Tokenizer::Scanner scanner(s, symbols);
+        return parse_tokens([&](Token& token) {
+            return scanner.next(token);
+        }, factory);
+    }
 }
 
 #endif
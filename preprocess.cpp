@@ -0,0 +1,356 @@
+#ifndef PREPROCESS_PREPROCESS_CPP
+#define PREPROCESS_PREPROCESS_CPP
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "parser.cpp"
+
+// Rewrites formulas once, before any engine sees them. Implications are
+// expanded and negations pushed down to the variables (negation normal
+// form), chains of `v` and `^` are flattened and rebuilt without repeated
+// or absorbed operands, and operands that make a chain constant, such as
+// `x` and `~x` in the same disjunction, collapse it.
+namespace Preprocess {
+    using Parser::Formula;
+    using Parser::UnaryFormula;
+    using Parser::BinaryFormula;
+    using Parser::NaryFormula;
+    using Parser::FormulaType;
+    using Parser::FormulaFactory;
+
+    using Tokenizer::Token;
+
+    struct Result {
+        // Whether the formulas were found to be a tautology outright, in
+        // which case `formulas` is empty
+        bool is_tautology = false;
+        // The simplified formulas, still joined by `v`
+        std::vector<Formula*> formulas;
+        // Distinct nodes, and size written out as trees, of the formulas
+        // before and after
+        std::size_t nodes_before = 0;
+        std::size_t nodes_after = 0;
+        std::uint64_t size_before = 0;
+        std::uint64_t size_after = 0;
+    };
+
+    std::size_t count_nodes(const FormulaFactory& factory, const std::vector<Formula*>& formulas) {
+        std::vector<bool> seen(factory.size(), false);
+        std::vector<Formula*> stack(formulas.begin(), formulas.end());
+        std::size_t count = 0;
+        while (!stack.empty()) {
+            Formula* formula = stack.back();
+            stack.pop_back();
+            if (seen[formula->id])
+                continue;
+            seen[formula->id] = true;
+            count++;
+            if (formula->type == FormulaType::Unary) {
+                stack.push_back(((UnaryFormula*)formula)->right);
+            } else if (formula->type == FormulaType::Binary) {
+                stack.push_back(((BinaryFormula*)formula)->right);
+                stack.push_back(((BinaryFormula*)formula)->left);
+            } else if (formula->type == FormulaType::Nary) {
+                auto op = (NaryFormula*)formula;
+                stack.insert(stack.end(), op->begin(), op->end());
+            }
+        }
+        return count;
+    }
+
+    std::uint64_t tree_size(const FormulaFactory& factory, const std::vector<Formula*>& formulas) {
+        std::uint64_t size = 0;
+        for (auto formula : formulas)
+            size += factory.pool().tree_size(formula->id);
+        return size;
+    }
+
+    namespace {
+        // A simplified formula, or a constant when `formula` is null. The
+        // constants have no formula of their own, and never survive the
+        // pass: they are absorbed by the chain they end up in.
+        struct Value {
+            Formula* formula;
+            bool constant;
+        };
+
+        // A formula taken with a polarity
+        struct Operand {
+            Formula* formula;
+            bool negated;
+        };
+
+        class Simplifier {
+            FormulaFactory& factory;
+            // Values of the input formulas and their negations, by
+            // `2*id + negated`
+            std::vector<Value> values;
+            std::vector<bool> done;
+            // Scratch marks for spotting repeated operands by id, and
+            // complementary literals by `2*variable + negated`
+            std::vector<bool> seen;
+            std::vector<bool> literal_seen;
+            // Marks the (formula, negated) pairs walked while gathering a
+            // run, by `2*id + negated`
+            std::vector<bool> in_run;
+
+            // `2*variable + negated` for a literal, or -1
+            static long literal(Formula* formula) {
+                if (formula->type == FormulaType::Atom)
+                    return 2l * formula->token.id();
+                if (formula->type == FormulaType::Unary and ((UnaryFormula*)formula)->right->type == FormulaType::Atom)
+                    return 2l * ((UnaryFormula*)formula)->right->token.id() + 1;
+                return -1;
+            }
+
+            // Appends the operands of a chain of `op`, made of binary
+            // formulas nested to the right and n-ary ones
+            static void flatten(Token op, Formula* formula, std::vector<Formula*>& operands) {
+                while (formula->type == FormulaType::Binary and formula->token == op) {
+                    operands.push_back(((BinaryFormula*)formula)->left);
+                    formula = ((BinaryFormula*)formula)->right;
+                }
+                if (formula->type == FormulaType::Nary and formula->token == op) {
+                    auto nary = (NaryFormula*)formula;
+                    for (auto operand : *nary)
+                        flatten(op, operand, operands);
+                } else {
+                    operands.push_back(formula);
+                }
+            }
+
+            // Drops each operand whose own operands, under the other
+            // connective, include all of another operand's: `a v (a ^ b)`
+            // is `a`, and `a ^ (a v b)` is `a`. Quadratic, so only done for
+            // chains of reasonable length.
+            static void absorb(Token op, std::vector<Formula*>& operands) {
+                constexpr std::size_t max_operands = 64;
+                if (operands.size() < 2 or operands.size() > max_operands)
+                    return;
+                Token inner = op == Token::Or ? Token::And : Token::Or;
+                std::vector<std::vector<unsigned>> sets(operands.size());
+                for (std::size_t i = 0; i < operands.size(); i++) {
+                    std::vector<Formula*> parts;
+                    flatten(inner, operands[i], parts);
+                    for (auto part : parts)
+                        sets[i].push_back(part->id);
+                    std::sort(sets[i].begin(), sets[i].end());
+                    sets[i].erase(std::unique(sets[i].begin(), sets[i].end()), sets[i].end());
+                }
+                std::vector<bool> dropped(operands.size(), false);
+                for (std::size_t i = 0; i < operands.size(); i++) {
+                    for (std::size_t j = 0; j < operands.size() and !dropped[i]; j++) {
+                        if (i == j or dropped[j] or sets[j].size() > sets[i].size())
+                            continue;
+                        // Of two operands with the same set, the first is kept
+                        if (sets[j].size() == sets[i].size() and j > i)
+                            continue;
+                        if (std::includes(sets[i].begin(), sets[i].end(), sets[j].begin(), sets[j].end()))
+                            dropped[i] = true;
+                    }
+                }
+                std::size_t kept = 0;
+                for (std::size_t i = 0; i < operands.size(); i++)
+                    if (!dropped[i])
+                        operands[kept++] = operands[i];
+                operands.resize(kept);
+            }
+
+        public:
+            Simplifier(FormulaFactory& factory)
+                : factory(factory), values(2 * factory.size()), done(2 * factory.size(), false),
+                  literal_seen(2 * factory.num_variables(), false), in_run(2 * factory.size(), false) {}
+
+            // Gathers the operands of `a op b op ...` for the given values,
+            // flattened, without repeats, and in order of first appearance.
+            // Returns false when the chain is constant: `op`'s absorbing
+            // element is among the values, or two operands are
+            // complementary literals.
+            bool gather(Token op, const std::vector<Value>& children, std::vector<Formula*>& operands) {
+                bool absorbing = op == Token::Or;
+                std::vector<Formula*> flat;
+                for (auto child : children) {
+                    if (child.formula == nullptr) {
+                        if (child.constant == absorbing)
+                            return false;
+                        continue;
+                    }
+                    flatten(op, child.formula, flat);
+                }
+
+                seen.resize(factory.size(), false);
+                bool complementary = false;
+                for (auto formula : flat) {
+                    if (seen[formula->id])
+                        continue;
+                    seen[formula->id] = true;
+                    long code = literal(formula);
+                    if (code >= 0) {
+                        if (literal_seen[code ^ 1])
+                            complementary = true;
+                        literal_seen[code] = true;
+                    }
+                    operands.push_back(formula);
+                }
+                for (auto formula : operands) {
+                    seen[formula->id] = false;
+                    long code = literal(formula);
+                    if (code >= 0)
+                        literal_seen[code] = false;
+                }
+                if (complementary)
+                    return false;
+                absorb(op, operands);
+                return true;
+            }
+
+            Value combine(Token op, const std::vector<Value>& children) {
+                std::vector<Formula*> operands;
+                if (!gather(op, children, operands))
+                    return {nullptr, op == Token::Or};
+                if (operands.empty())
+                    return {nullptr, op == Token::And};
+                return {factory.makeNaryFormula(op, operands), false};
+            }
+
+            // The connective `formula`, negated if `negated`, stands for in
+            // negation normal form, or `Token::LParen` when it is a literal:
+            // `a -> b` is read as `~a v b`, and negated chains by De Morgan's
+            // laws
+            static Token connective(Formula* formula, bool negated) {
+                if (formula->type != FormulaType::Binary and formula->type != FormulaType::Nary)
+                    return Token::LParen;
+                return (formula->token == Token::And) != negated ? Token::And : Token::Or;
+            }
+
+            // Appends the operands, with their polarity, of the whole run of
+            // `op` that `formula` is the top of. Negations are looked
+            // through, and a formula shared within the run is only walked
+            // once, so each run is gathered in time linear in its size
+            // rather than once for every level of nesting.
+            void gather_run(Token op, Formula* top, bool top_negated, std::vector<Operand>& operands) {
+                std::vector<Operand> stack{{top, top_negated}};
+                std::vector<std::size_t> walked;
+                while (!stack.empty()) {
+                    auto [formula, negated] = stack.back();
+                    stack.pop_back();
+                    while (formula->type == FormulaType::Unary) {
+                        formula = ((UnaryFormula*)formula)->right;
+                        negated = !negated;
+                    }
+                    if (!(connective(formula, negated) == op)) {
+                        operands.push_back({formula, negated});
+                        continue;
+                    }
+                    std::size_t key = 2 * formula->id + negated;
+                    if (in_run[key])
+                        continue;
+                    in_run[key] = true;
+                    walked.push_back(key);
+                    if (formula->type == FormulaType::Binary) {
+                        auto binary = (BinaryFormula*)formula;
+                        stack.push_back({binary->right, negated});
+                        stack.push_back({binary->left, binary->token == Token::Implies ? !negated : negated});
+                    } else {
+                        auto nary = (NaryFormula*)formula;
+                        for (unsigned i = nary->arity; i-- > 0;)
+                            stack.push_back({nary->operands[i], negated});
+                    }
+                }
+                for (auto key : walked)
+                    in_run[key] = false;
+            }
+
+            // The value of `formula`, negated if asked, in negation normal
+            // form
+            Value simplify(Formula* root, bool root_negated) {
+                // Post-order walk over (formula, negated) pairs: a pair is
+                // combined the second time it is seen, once its operands
+                // have been. The operands of the runs being combined are
+                // kept innermost last.
+                struct Frame {
+                    Formula* formula;
+                    bool negated;
+                    bool expanded;
+                };
+                std::vector<Frame> stack{{root, root_negated, false}};
+                std::vector<std::vector<Operand>> runs;
+                while (!stack.empty()) {
+                    auto [formula, negated, expanded] = stack.back();
+                    stack.pop_back();
+                    std::size_t key = 2 * formula->id + negated;
+                    if (done[key])
+                        continue;
+                    switch (formula->type) {
+                        // Case: a variable - a literal as it is
+                        case FormulaType::Atom:
+                            values[key] = {negated ? factory.makeNegation(formula) : formula, false};
+                            break;
+                        // Case: a negation - the operand with the other polarity
+                        case FormulaType::Unary: {
+                            auto op = (UnaryFormula*)formula;
+                            std::size_t operand = 2 * op->right->id + !negated;
+                            if (!expanded) {
+                                stack.push_back({formula, negated, true});
+                                stack.push_back({op->right, !negated, false});
+                                continue;
+                            }
+                            values[key] = values[operand];
+                            break;
+                        }
+                        // Case: a binary or n-ary operation - the whole run of
+                        // `v` or `^` below it, gathered at once, as one chain
+                        case FormulaType::Binary:
+                        case FormulaType::Nary: {
+                            Token op = connective(formula, negated);
+                            if (!expanded) {
+                                stack.push_back({formula, negated, true});
+                                runs.emplace_back();
+                                gather_run(op, formula, negated, runs.back());
+                                for (std::size_t i = runs.back().size(); i-- > 0;)
+                                    stack.push_back({runs.back()[i].formula, runs.back()[i].negated, false});
+                                continue;
+                            }
+                            std::vector<Value> children;
+                            for (auto operand : runs.back())
+                                children.push_back(values[2 * operand.formula->id + operand.negated]);
+                            runs.pop_back();
+                            values[key] = combine(op, children);
+                            break;
+                        }
+                    }
+                    done[key] = true;
+                }
+                return values[2 * root->id + root_negated];
+            }
+        };
+    }
+
+    // Simplifies a set of formulas joined by `v`. Only nodes of `factory`
+    // are rewritten; every node the result needs is made in it as well.
+    Result simplify(FormulaFactory& factory, const std::vector<Formula*>& formulas) {
+        Result result;
+        result.nodes_before = count_nodes(factory, formulas);
+        result.size_before = tree_size(factory, formulas);
+
+        Simplifier simplifier(factory);
+        std::vector<Value> values;
+        for (auto formula : formulas)
+            values.push_back(simplifier.simplify(formula, false));
+        // The top level is a disjunction too, so it is flattened into the
+        // list of formulas rather than built as a chain
+        if (!simplifier.gather(Token::Or, values, result.formulas)) {
+            result.is_tautology = true;
+            result.formulas.clear();
+        }
+
+        result.nodes_after = count_nodes(factory, result.formulas);
+        result.size_after = tree_size(factory, result.formulas);
+        return result;
+    }
+}
+
+#endif
@@ -1,200 +1,1659 @@
 #ifndef RS_SYSTEM_RS_SYSTEM_CPP
 #define RS_SYSTEM_RS_SYSTEM_CPP
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <deque>
+#include <exception>
+#include <functional>
 #include <vector>
 #include <list>
+#include <mutex>
+#include <span>
+#include <stop_token>
 #include <utility>
 #include <iostream>
 
 #include "parser.cpp"
 #include "tokenizer.cpp"
 #include "bitset.hpp"
+#include "work-stealing-pool.hpp"
+#include "transposition-table.hpp"
+#include "buffered-writer.hpp"
+#include "mapped-file.hpp"
+#include "truth-table.cpp"
+#include "sat-solver.cpp"
+#include "bdd.cpp"
+#include "preprocess.cpp"
 
 namespace RSSystem {
     using Parser::Formula;
     using Parser::UnaryFormula;
     using Parser::BinaryFormula;
+    using Parser::NaryFormula;
     using Parser::FormulaType;
     using Parser::FormulaFactory;
+    using Parser::FormulaPool;
+    using Parser::NodeId;
+    using Parser::no_node;
 
     using Tokenizer::Token;
+    using Tokenizer::SymbolTable;
 
     using FormulaStrings = std::vector<std::string>;
-    using IndecomposableSequence = std::vector<Formula*>;
-    using DecomposableSequence = std::list<Formula*>;
-    using FormulaSequence = std::pair<IndecomposableSequence, DecomposableSequence>;
-
-    Formula* negate(Formula* formula) {
-        auto neg_formula = FormulaFactory::makeUnaryFormula(Tokenizer::Token::Not);
-        neg_formula->right = formula;
-        return neg_formula;
-    }
-
-    bool is_tautology(FormulaStrings str_formulas, bool print_leaves = false) {
-        // A list of pairs of indecomposable and decomposable sequences
-        std::list<FormulaSequence> sequences;
-
-        // Convert the input strings to formula objects
-        DecomposableSequence init_decomps;
-        for (auto str_formula : str_formulas) {
-            auto tokens = Tokenizer::tokenize(str_formula);
-            auto formula = Parser::parse(tokens);
-            init_decomps.push_back(formula);
-        }
-        IndecomposableSequence init_indecomps;
-        sequences.emplace_back(init_indecomps,init_decomps);
-
-        // Begin with the first sequence
-        auto curr_seq_it = sequences.begin();
-
-        // bitsets to keep track of which variables are in indecomposable
-        // sequences. `in_pos` keeps track of what variables are in the
-        // sequence, `in_neg` keeps track of what negation of variables are
-        // in the sequence.
-        bitset in_pos(Token::num_variables());
-        bitset in_neg(Token::num_variables());
-        bool is_fundamental;
-        int i = 0;
-
-        // Loop through all in/decomposable sequence pairs, as more may be created
-        while (curr_seq_it != sequences.end()) {
-            auto& [i_seq, d_seq] = *curr_seq_it;
-            auto curr_formula_it = d_seq.begin();
-
-            // Loop through the first potentiall decomposable sequence
-            while (curr_formula_it != d_seq.end()) {
-                auto curr_formula = *curr_formula_it;
-                // Split into cases based on what the current formula type is
-                switch (curr_formula->type) {
-                    // Case: next formula is a single variable - add to i_seq
+    // An immutable list of formulas, by their id in the factory's pool.
+    // Lists are only ever extended at the front, so a sequence and
+    // everything derived from it share their common tail, and forking a
+    // branch never copies a sequence.
+    //
+    // Each formula also carries the set of branching rules it descends
+    // from, as a mask of levels on the path from the root (see
+    // `Prover::level_bit`). `hash` is a hash of the formulas in the list
+    // that does not depend on their order.
+    struct Sequence {
+        NodeId head;
+        const Sequence* tail;
+        std::uint64_t deps;
+        std::uint64_t hash;
+    };
+
+    // Leftmost formula first
+    using DecomposableSequence = const Sequence*;
+    // Most recently found formula first
+    using IndecomposableSequence = const Sequence*;
+
+    // A branching rule applied while the tree is explored in parallel,
+    // shared by the tasks for its branches and by the rules applied within
+    // them. As the sequential search does with its levels, branches report
+    // what the complementary pairs that closed them descended from, and a
+    // branch that closed without the rule's formula makes the rest of the
+    // rule's branches redundant. `core` gathers what the finished branches
+    // descended from, bar the rule itself, and `pending` counts the
+    // branches not finished yet. Once `resolved`, the rule has reported to
+    // its parent, and tasks within it are skipped.
+    struct Split {
+        // Counted by `SplitRef`
+        Split* parent;
+        std::size_t depth;
+        std::atomic<std::uint64_t> core{0};
+        std::atomic<std::size_t> pending;
+        std::atomic<bool> resolved{false};
+        std::atomic<std::size_t> refs{1};
+    };
+
+    // A counted reference to a `Split`, which lives as long as any task,
+    // prover or rule below it refers to it. The last reference to a rule
+    // lets go of its parent in a loop rather than recursively, so that a
+    // deep tree cannot overflow the call stack.
+    class SplitRef {
+        Split* split = nullptr;
+
+        static void release(Split* split) {
+            while (split != nullptr and split->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                Split* parent = split->parent;
+                delete split;
+                split = parent;
+            }
+        }
+
+    public:
+        SplitRef() = default;
+        SplitRef(std::nullptr_t) {}
+
+        // A new rule with `branches` branches, `depth` rules below the root,
+        // applied within `parent`
+        SplitRef(const SplitRef& parent, std::size_t depth, std::size_t branches)
+            : split(new Split{SplitRef(parent).detach(), depth, {0}, {branches}, {false}, {1}}) {}
+
+        SplitRef(const SplitRef& other) : split(other.split) {
+            if (split != nullptr)
+                split->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        SplitRef(SplitRef&& other) noexcept : split(std::exchange(other.split, nullptr)) {}
+
+        SplitRef& operator=(SplitRef other) noexcept {
+            std::swap(split, other.split);
+            return *this;
+        }
+
+        ~SplitRef() {
+            release(split);
+        }
+
+        // Gives up the reference without letting go of it
+        Split* detach() {
+            return std::exchange(split, nullptr);
+        }
+
+        Split* get() const {
+            return split;
+        }
+
+        Split* operator->() const {
+            return split;
+        }
+    };
+
+    // A branching rule that has been applied, but whose second branch has
+    // not been explored yet. When the tree is explored in parallel, these
+    // are the tasks that workers hand to each other. `d_seq`, `i_seq` and
+    // `betas` are the sequences left once the branching formula was taken
+    // off, `deps` is what the alternative descends from, `cells` is where
+    // the first branch started allocating sequence cells, and `literals` is
+    // how many literals had been recorded at the time. An n-way rule has
+    // more branches after the alternative: one for each operand in
+    // [`rest`, `rest_end`), negated if `negate_rest`. In parallel, `split`
+    // is the rule the branch belongs to, or null for the root.
+    struct ChoicePoint {
+        DecomposableSequence d_seq;
+        IndecomposableSequence i_seq;
+        DecomposableSequence betas;
+        NodeId alternative;
+        std::uint64_t deps;
+        arena::position cells;
+        std::size_t literals;
+        const NodeId* rest = nullptr;
+        const NodeId* rest_end = nullptr;
+        bool negate_rest = false;
+        SplitRef split = nullptr;
+    };
+
+    // The procedures `is_tautology` can decide a formula with
+    enum class Engine {
+        // Pick one from the size of the formula and its number of variables
+        Auto,
+        // Decompose the formula into an RS tree
+        RS,
+        // Evaluate the formula under every assignment of its variables. A
+        // formula with more than `TruthTable::max_enumerable_variables`
+        // variables is rejected with an exception.
+        TruthTable,
+        // Search for a model of the formula's negation with a CDCL solver
+        SAT,
+        // Build the formula's reduced ordered binary decision diagram
+        BDD
+    };
+
+    std::string to_str(Engine engine) {
+        switch (engine) {
+            case Engine::Auto: return "auto";
+            case Engine::RS: return "rs";
+            case Engine::TruthTable: return "truth-table";
+            case Engine::SAT: return "sat";
+            case Engine::BDD: return "bdd";
+        }
+        return "";
+    }
+
+    // The order the RS engine applies rules in
+    enum class Schedule {
+        // Always decompose the leftmost formula
+        LeftToRight,
+        // Apply every non-branching rule first, and only then pick one
+        // branching formula (AND, ~OR, ~IMPLIES) to split on: one that has
+        // a branch closing against the literals found so far if there is
+        // one, and otherwise the largest, which leaves the most for the
+        // non-branching rules to work on in both branches
+        AlphaFirst
+    };
+
+    struct Options {
+        Engine engine = Engine::Auto;
+        Schedule schedule = Schedule::LeftToRight;
+        // Rewrite the formulas into negation normal form, with flattened
+        // and deduplicated `v`/`^` chains, before deciding them
+        bool preprocess = false;
+        // Print every leaf of the tree as it is checked. Only the RS engine
+        // has leaves, so `Engine::Auto` always picks it when this is set.
+        bool print_leaves = false;
+        // Number of threads exploring the tree, or 0 for one per hardware
+        // thread. With more than one, branches are spawned as tasks on a
+        // work-stealing pool and leaves are printed in no particular order.
+        // A long list of formulas is also tokenized on this many threads.
+        unsigned threads = 1;
+        // Skip the second branch of a branching rule when the first one
+        // closed without using the formula the rule introduced, as the
+        // same complementary pairs then close the second branch too. In
+        // parallel, branches that another worker has already started on
+        // are given up at their next leaf.
+        bool backjump = true;
+        // Memory for remembering branches that were found to be
+        // fundamental, so that reaching the same formulas and literals
+        // again closes the branch at once, or 0 to not remember them. Pays
+        // off when many paths reach the same branch, and otherwise costs
+        // building a key for every large subtree.
+        //
+        // Only used by the sequential search: with `threads` other than 1,
+        // or when printing leaves, nothing is remembered and the memo
+        // statistics stay 0. Backjumping, above, is done either way.
+        std::size_t memo_bytes = 0;
+    };
+
+    // Counters describing the memory used by a single call to `is_tautology`
+    struct Statistics {
+        // Formula nodes created by the parser and by rule applications
+        std::size_t formula_nodes = 0;
+        std::size_t formula_bytes = 0;
+        // General-purpose heap allocations made by the node arena
+        std::size_t formula_chunks = 0;
+        // Size of the same nodes in the factory's pool
+        std::size_t formula_pool_bytes = 0;
+        // The subset of the above made while decomposing sequences,
+        // including the negations built for the rules before the search
+        std::size_t decomposition_nodes = 0;
+        // Heap allocations made while decomposing: chunks of the node arena
+        // and of the provers' sequence cell arenas, and rules shared between
+        // workers. Growth of the provers' scratch vectors is not counted.
+        std::size_t decomposition_chunks = 0;
+        // Leaves of the tree that were checked
+        std::size_t leaves = 0;
+        // Branches that were taken over by an idle worker
+        std::size_t steals = 0;
+        // Second branches skipped by backjumping, or in parallel, branch
+        // tasks skipped because a backjump made them redundant
+        std::size_t pruned = 0;
+        // Branches closed because they had been seen before, branches
+        // remembered at the end, and branches forgotten to stay in budget
+        std::size_t memo_hits = 0;
+        std::size_t memo_entries = 0;
+        std::size_t memo_evictions = 0;
+        // Distinct formula nodes and tree size before and after
+        // preprocessing, when it was done
+        std::size_t preprocess_nodes_before = 0;
+        std::size_t preprocess_nodes_after = 0;
+        std::uint64_t preprocess_size_before = 0;
+        std::uint64_t preprocess_size_after = 0;
+        // The engine that decided the formula, or `Engine::Auto` if
+        // preprocessing alone did
+        Engine engine = Engine::Auto;
+        // Assignments evaluated by the truth table engine
+        std::uint64_t assignments = 0;
+        // Work done by the SAT engine
+        std::uint64_t conflicts = 0;
+        std::uint64_t decisions = 0;
+        // Size of the BDD engine's node store
+        std::size_t bdd_nodes = 0;
+        std::size_t bdd_bytes = 0;
+    };
+
+    // What a caller keeps from one check to the next. Each check clears the
+    // session's symbol table before reading its formulas, so variable ids,
+    // and the bitsets indexed by them, only ever cover the formulas of the
+    // current check, while the table's memory is reused. Checks in
+    // different sessions share nothing and can run on different threads.
+    struct Session {
+        SymbolTable symbols;
+
+        void reset() {
+            symbols.clear();
+        }
+    };
+
+    // Bounds on a check, past which it gives up without an answer
+    struct Limits {
+        // Time by which the check must be over
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+        // Work the check may do, or 0 for no limit: rule applications of
+        // the RS engine, assignments evaluated by the truth table, conflicts
+        // of the SAT solver, or nodes of the BDD
+        std::uint64_t max_steps = 0;
+        // Leaves of the RS tree that may be checked, or 0 for no limit.
+        // Workers exploring the tree in parallel may each check one more
+        // before they notice.
+        std::size_t max_leaves = 0;
+        // A stop requested through the token's source ends the check, from
+        // any thread
+        std::stop_token stop;
+    };
+
+    enum class Verdict {
+        Tautology,
+        NotTautology,
+        // A limit was reached first
+        Unknown
+    };
+
+    // Which limit ended a check
+    enum class StopReason {
+        None,
+        Deadline,
+        Budget,
+        Leaves,
+        Cancelled
+    };
+
+    std::string to_str(Verdict verdict) {
+        switch (verdict) {
+            case Verdict::Tautology: return "tautology";
+            case Verdict::NotTautology: return "not tautology";
+            case Verdict::Unknown: return "unknown";
+        }
+        return "";
+    }
+
+    std::string to_str(StopReason reason) {
+        switch (reason) {
+            case StopReason::None: return "none";
+            case StopReason::Deadline: return "deadline";
+            case StopReason::Budget: return "budget";
+            case StopReason::Leaves: return "leaf limit";
+            case StopReason::Cancelled: return "cancelled";
+        }
+        return "";
+    }
+
+    struct Result {
+        Verdict verdict = Verdict::Unknown;
+        // For `NotTautology`, the value of each variable, by id in the
+        // session's symbol table, in an assignment that makes every
+        // formula false
+        std::vector<bool> counterexample;
+        // For `Unknown`, the limit that was reached
+        StopReason stopped = StopReason::None;
+        // What the check did, up to where it stopped
+        Statistics stats;
+    };
+
+    // `variable = value` for each variable of a counterexample
+    std::string to_str(const SymbolTable& symbols, const std::vector<bool>& counterexample) {
+        std::string str;
+        for (unsigned id = 0; id < counterexample.size(); id++) {
+            if (id > 0)
+                str += ", ";
+            str += symbols.name(Token::Variable(id));
+            str += counterexample[id] ? " = true" : " = false";
+        }
+        return str;
+    }
+
+    // Negations are shared through the factory, so firing the same rule on
+    // the same formula twice does not create a second node
+    Formula* negate(FormulaFactory& factory, Formula* formula) {
+        return factory.makeNegation(formula);
+    }
+
+    // Builds every negation the rules can ask for while decomposing
+    // `formulas`. Those are the negations of the operands of binary and
+    // n-ary formulas, as neither is ever created by the rules. Afterwards
+    // the rules only read the factory's pool, so any number of threads can
+    // share it.
+    void prepare_negations(FormulaFactory& factory, const std::vector<Formula*>& formulas) {
+        std::vector<bool> visited(factory.size(), false);
+        std::vector<Formula*> stack(formulas.begin(), formulas.end());
+        while (!stack.empty()) {
+            Formula* formula = stack.back();
+            stack.pop_back();
+            if (visited[formula->id])
+                continue;
+            visited[formula->id] = true;
+            switch (formula->type) {
+                case FormulaType::Atom:
+                    break;
+                case FormulaType::Unary:
+                    stack.push_back(((UnaryFormula*)formula)->right);
+                    break;
+                case FormulaType::Binary: {
+                    auto op = (BinaryFormula*)formula;
+                    negate(factory, op->left);
+                    negate(factory, op->right);
+                    stack.push_back(op->left);
+                    stack.push_back(op->right);
+                    break;
+                }
+                case FormulaType::Nary:
+                    for (auto operand : *(NaryFormula*)formula) {
+                        negate(factory, operand);
+                        stack.push_back(operand);
+                    }
+                    break;
+            }
+        }
+    }
+
+    // The number of leaves of the RS tree for `formulas`, if no branch was
+    // closed early. Every formula is taken with the polarity its rules see
+    // it in: OR-like rules (OR, IMPLIES, ~AND) multiply the leaves of their
+    // operands, and AND-like rules (AND, ~OR, ~IMPLIES) add them.
+    double estimate_leaves(const FormulaFactory& factory, const std::vector<Formula*>& formulas) {
+        // leaves[2*id + negated], or a negative number until computed
+        std::vector<double> leaves(2 * factory.size(), -1);
+        auto get = [&](Formula* formula, bool negated) {
+            return leaves[2 * formula->id + negated];
+        };
+        std::vector<std::pair<Formula*, bool>> stack;
+        double total = 1;
+        for (auto root : formulas) {
+            stack.push_back({root, false});
+            while (!stack.empty()) {
+                auto [formula, negated] = stack.back();
+                if (get(formula, negated) >= 0) {
+                    stack.pop_back();
+                    continue;
+                }
+                double count = -1;
+                switch (formula->type) {
                     case FormulaType::Atom:
-                        i_seq.push_back(curr_formula);
-                        curr_formula_it = d_seq.erase(curr_formula_it);
+                        count = 1;
                         break;
-                        // Case: next formula is the negation of something
                     case FormulaType::Unary: {
-                        auto op = (UnaryFormula*)curr_formula;
-                        if (op->token == Token::Not) {
-                            auto sub_formula = op->right;
-                            // Split into cases based on what is being negated
-                            switch (sub_formula->type) {
-                                // Case: next formula is the negation of a variable - add to i_seq
-                                case FormulaType::Atom:
-                                    i_seq.push_back(curr_formula);
-                                    curr_formula_it = d_seq.erase(curr_formula_it);
-                                    break;
-                                    // Case: next formula is negation of a negation - cancel them
-                                case FormulaType::Unary: {
-                                    auto sub_op = (UnaryFormula*)sub_formula;
-                                    if (op->token == Token::Not) {
-                                        auto sub_sub_formula = sub_op->right;
-                                        *curr_formula_it = sub_sub_formula;
-                                    }
-                                    break;
-                                }
-                                // Case: next formula is negation of a binary operation
-                                case FormulaType::Binary: {
-                                    auto op = (BinaryFormula*)sub_formula;
-                                    // Case: next formula is negation of AND
-                                    if (op->token == Token::And) {
-                                        d_seq.insert(curr_formula_it, negate(op->left));
-                                        *curr_formula_it = negate(op->right);
-                                        --curr_formula_it;
-                                        // Case: next formula is negation of OR
-                                    } else if (op->token == Token::Or) {
-                                        *curr_formula_it = negate(op->left);
-                                        sequences.emplace(curr_seq_it, i_seq, d_seq);
-                                        *curr_formula_it = negate(op->right);
-                                        --curr_seq_it;
-                                        goto break_outer;
-                                        // Case: next formula is negation of IMPLIES
-                                    } else if (op->token == Token::Implies) {
-                                        *curr_formula_it = op->left;
-                                        sequences.emplace(curr_seq_it, i_seq, d_seq);
-                                        *curr_formula_it = negate(op->right);
-                                        --curr_seq_it;
-                                        goto break_outer;
-                                    }
-                                    break;
-                                }
-                            }
-                        }
+                        auto sub = ((UnaryFormula*)formula)->right;
+                        if (get(sub, !negated) < 0)
+                            stack.push_back({sub, !negated});
+                        else
+                            count = get(sub, !negated);
                         break;
                     }
-                    // Case: next formula is a binary formula
                     case FormulaType::Binary: {
-                        auto op = (BinaryFormula*)curr_formula;
-                        // Case: next formula is an AND
-                        if (op->token == Token::And) {
-                            *curr_formula_it = op->left;
-                            sequences.emplace(curr_seq_it, i_seq, d_seq);
-                            *curr_formula_it = op->right;
-                            --curr_seq_it;
-                            goto break_outer;
-                            // Case: next formula is an OR
-                        } else if (op->token == Token::Or) {
-                            d_seq.insert(curr_formula_it, op->left);
-                            *curr_formula_it = op->right;
-                            --curr_formula_it;
-                            // Case: next formula is an IMPLIES
-                        } else if (op->token == Token::Implies) {
-                            d_seq.insert(curr_formula_it, negate(op->left));
-                            *curr_formula_it = op->right;
-                            --curr_formula_it;
+                        auto op = (BinaryFormula*)formula;
+                        // Polarity each operand is decomposed with
+                        bool left_negated = op->token == Token::Implies ? !negated : negated;
+                        bool right_negated = negated;
+                        double left = get(op->left, left_negated);
+                        double right = get(op->right, right_negated);
+                        if (left < 0 or right < 0) {
+                            if (left < 0)
+                                stack.push_back({op->left, left_negated});
+                            if (right < 0)
+                                stack.push_back({op->right, right_negated});
+                            break;
                         }
+                        bool splits = (op->token == Token::And) != negated;
+                        count = splits ? left + right : left * right;
                         break;
                     }
+                    case FormulaType::Nary: {
+                        auto op = (NaryFormula*)formula;
+                        bool ready = true;
+                        for (auto operand : *op) {
+                            if (get(operand, negated) < 0) {
+                                stack.push_back({operand, negated});
+                                ready = false;
+                            }
+                        }
+                        if (!ready)
+                            break;
+                        bool splits = (op->token == Token::And) != negated;
+                        count = splits ? 0 : 1;
+                        for (auto operand : *op)
+                            count = splits ? count + get(operand, negated) : count * get(operand, negated);
+                        break;
+                    }
+                }
+                if (count >= 0) {
+                    leaves[2 * formula->id + negated] = count;
+                    stack.pop_back();
                 }
             }
+            total *= get(root, false);
+        }
+        return total;
+    }
 
-            // Full indecomposable sequence found, check if fundamental
-            i++;
+    // RS trees with more leaves than this go to the SAT engine instead
+    constexpr double max_rs_leaves = 1e6;
 
-            // Reset bitsets to keep track of which variables and their
-            // negations are in the indecomposable sequence.
-            in_pos.reset();
-            in_neg.reset();
+    // Prefers the truth table when enumerating the assignments is cheaper
+    // than the RS tree would be without any early closures, and the SAT
+    // solver when neither is small
+    Engine choose_engine(const FormulaFactory& factory, const std::vector<Formula*>& formulas, const Options& options, const TruthTable::Program& program) {
+        if (options.engine != Engine::Auto)
+            return options.engine;
+        if (options.print_leaves)
+            return Engine::RS;
+        double leaves = estimate_leaves(factory, formulas);
+        double tree_cost = leaves * program.variables.size();
+        if (program.variables.size() <= TruthTable::max_variables) {
+            double table_cost = std::ldexp((double)program.code.size(), (int)program.variables.size() - TruthTable::block_bits);
+            if (table_cost < tree_cost and table_cost < max_rs_leaves * program.code.size())
+                return Engine::TruthTable;
+        }
+        return leaves > max_rs_leaves ? Engine::SAT : Engine::RS;
+    }
 
-            // This could actually be done more efficiently if I didn't
-            // need to print out the whole sequence. I could use bitsets
-            // instead of lists of formulas for i_seq above, which would
-            // remove redundancies, and I could terminate processing a
-            // sequence if the current indecomposable portion is fundamental
-            for (auto formula : i_seq) {
-                switch (formula->type) {
-                    // Case: variable
-                    case FormulaType::Atom: {
-                        in_pos.set(formula->token.id());
-                        break;
+    namespace {
+        // Tells a check when to give up. Any number of threads can ask at
+        // once, and the first limit found to be reached is kept.
+        class Watchdog {
+            const Limits& limits;
+            std::atomic<StopReason> reason{StopReason::None};
+
+        public:
+            Watchdog(const Limits& limits) : limits(limits) {}
+
+            // Ends the check, unless it was already ended for another reason
+            void stop(StopReason why) {
+                StopReason none = StopReason::None;
+                reason.compare_exchange_strong(none, why);
+            }
+
+            // Whether the check should give up, having done `steps` units
+            // of work
+            bool expired(std::uint64_t steps) {
+                if (reason != StopReason::None)
+                    return true;
+                if (limits.stop.stop_requested())
+                    stop(StopReason::Cancelled);
+                else if (limits.max_steps != 0 and steps >= limits.max_steps)
+                    stop(StopReason::Budget);
+                else if (limits.deadline != std::chrono::steady_clock::time_point::max() and std::chrono::steady_clock::now() >= limits.deadline)
+                    stop(StopReason::Deadline);
+                return reason != StopReason::None;
+            }
+
+            StopReason stopped() const {
+                return reason;
+            }
+
+            // `expired`, for the engines that only take a callback
+            std::function<bool(std::uint64_t)> callback() {
+                return [this](std::uint64_t steps) { return expired(steps); };
+            }
+        };
+
+        // State shared by every prover taking part in one check
+        struct Search {
+            FormulaFactory& factory;
+            const SymbolTable& symbols;
+            const Options& options;
+            const Limits& limits;
+            Watchdog& watchdog;
+
+            Search(FormulaFactory& factory, const SymbolTable& symbols, const Options& options, const Limits& limits, Watchdog& watchdog)
+                : factory(factory), symbols(symbols), options(options), limits(limits), watchdog(watchdog) {}
+
+            std::atomic<std::size_t> leaves{0};
+            std::atomic<std::size_t> pruned{0};
+            // Rules shared between workers, each allocated on the heap
+            std::atomic<std::size_t> splits{0};
+            // Rule applications, counted a batch at a time
+            std::atomic<std::uint64_t> steps{0};
+            // Leaves printed so far, written out a block at a time
+            std::mutex print_lock;
+            buffered_writer trace{std::cout};
+            // The literals, as `2*id + negated`, of the first leaf found not
+            // to be fundamental
+            std::mutex open_leaf_lock;
+            bool found_open_leaf = false;
+            std::vector<unsigned> open_leaf;
+        };
+
+        // Explores the RS tree depth first, one branch at a time, keeping
+        // the branch's decomposable and indecomposable formulas in
+        // persistent sequences. Their cells come from the prover's own
+        // arena, which is rewound whenever the search backtracks.
+        //
+        // On its own, a prover keeps the branching rules on the path to the
+        // current branch on its `levels` stack, and backjumps over second
+        // branches that cannot matter. Given a pool, it pushes second
+        // branches onto its worker's deque instead, and stops at every leaf
+        // so the pool can hand it its next branch. The rules are then kept
+        // as `Split`s shared between the workers, and a branch whose rule,
+        // or any rule above it, has been resolved is skipped.
+        class Prover {
+            Search& search;
+            // The formulas, read by id
+            const FormulaPool& nodes;
+            work_stealing_pool<ChoicePoint>* pool;
+            unsigned worker;
+            // Whether i_seq is needed, for printing or to rebuild the bitsets
+            // of a branch that another worker takes over
+            bool keep_i_seq;
+
+            arena cells;
+            DecomposableSequence d_seq = nullptr;
+            IndecomposableSequence i_seq = nullptr;
+            // Branching formulas put aside until no other rule applies, when
+            // scheduling alpha rules first
+            DecomposableSequence betas = nullptr;
+
+            // bitsets to keep track of which variables are in the current
+            // branch's indecomposable sequence. `in_pos` keeps track of what
+            // variables are in the sequence, `in_neg` keeps track of what
+            // negation of variables are in the sequence. `literals` lists the
+            // bits that have been set, in order, as `2*id + negated`, so they
+            // can be cleared again on backtracking.
+            bitset<> in_pos;
+            bitset<> in_neg;
+            std::vector<unsigned> literals;
+            // What each literal in the bitsets descends from, by `2*id + negated`
+            std::vector<std::uint64_t> literal_deps;
+            bool is_fundamental = false;
+            // Whether the branch was closed by the memo rather than by a
+            // complementary pair, so it is not a leaf
+            bool remembered = false;
+            // What the complementary pair that closed the branch descends from
+            std::uint64_t core = 0;
+            // Given a pool, the innermost rule on the path to the current
+            // branch, or null at the root
+            SplitRef context;
+
+            // A branching rule on the path to the current branch. `choice`
+            // is its next branch to explore, and `remaining` how many of its
+            // branches are left after the current one. `core` is what the
+            // closures of its branches closed so far descended from, bar the
+            // rule itself. `split` is the cell of the formula the rule was
+            // applied to, `hash` the memo hash of the branch it split, and
+            // `closed` the prover's count of closed branches at the time.
+            struct Level {
+                ChoicePoint choice;
+                std::size_t remaining;
+                std::uint64_t core;
+                const Sequence* split;
+                std::uint64_t hash;
+                std::size_t closed;
+            };
+            // Innermost last
+            std::vector<Level> levels;
+
+            // Branches known to be fundamental, keyed by the ids of the
+            // formulas left to decompose, then the literals. Their hash is
+            // kept up to date as the branch changes, and the key itself is
+            // only built to insert a branch or confirm a match.
+            transposition_table memo;
+            std::vector<unsigned> key;
+            std::uint64_t literal_hash = 0;
+            // Leaves and remembered branches closed so far
+            std::size_t closed = 0;
+            // Rule applications not yet added to the search's count, and
+            // whether the limits have ended the search
+            std::uint64_t steps = 0;
+            bool stopped = false;
+            // Rule applications between looks at the limits
+            static constexpr std::uint64_t step_interval = 1024;
+            // The literals of the leaf being printed
+            std::vector<NodeId> leaf;
+            // The cells in front of the beta being split, reused by each split
+            std::vector<const Sequence*> prefix;
+            // Branches that closed after fewer leaves are not worth
+            // remembering
+            static constexpr std::size_t memo_min_closed = 8;
+
+            static std::uint64_t scramble(std::uint64_t x) {
+                x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+                x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+                return x ^ (x >> 31);
+            }
+
+            static std::uint64_t literal_code(unsigned literal) {
+                return scramble(literal | (std::uint64_t(1) << 32));
+            }
+
+            // Levels past the 63rd share the last bit, which is never cleared
+            // and never lets them be skipped
+            static std::uint64_t level_bit(std::size_t level) {
+                return std::uint64_t(1) << std::min<std::size_t>(level, 63);
+            }
+
+            // Number of branching rules on the path to the current branch
+            std::size_t depth() const {
+                if (pool == nullptr)
+                    return levels.size();
+                return context.get() != nullptr ? context->depth + 1 : 0;
+            }
+
+            // Whether a rule at or above `split` has been resolved, so that
+            // its branches no longer matter
+            static bool abandoned(const Split* split) {
+                for (; split != nullptr; split = split->parent)
+                    if (split->resolved)
+                        return true;
+                return false;
+            }
+
+            // Reports a branch of `split` as closed, by complementary pairs
+            // that descend from `core`, and the same for every rule that
+            // this finishes in turn. The backjumping is the same as in
+            // `explore`.
+            void finish(Split* split, std::uint64_t core) {
+                for (; split != nullptr; split = split->parent) {
+                    if (split->resolved)
+                        return;
+                    std::uint64_t bit = split->depth < 63 ? level_bit(split->depth) : 0;
+                    if (search.options.backjump and bit != 0 and !(core & bit)) {
+                        if (split->resolved.exchange(true))
+                            return;
+                        continue;
                     }
-                    // Case: negation of a variable
-                    case FormulaType::Unary: {
-                        in_neg.set(((UnaryFormula*)formula)->right->token.id());
-                        break;
+                    split->core |= core & ~bit;
+                    if (--split->pending > 0 or split->resolved.exchange(true))
+                        return;
+                    core = split->core;
+                }
+            }
+
+            const Sequence* push(NodeId formula, const Sequence* seq, std::uint64_t deps) {
+                std::uint64_t hash = (seq != nullptr ? seq->hash : 0) + scramble(formula);
+                return new (cells.allocate(sizeof(Sequence), alignof(Sequence))) Sequence{formula, seq, deps, hash};
+            }
+
+            // Builds the memo key of a branch into `key`: the sorted ids of
+            // the formulas in `seq` and `betas`, then its first `num_literals`
+            // literals, sorted. Also gathers what they all descend from.
+            void build_key(const Sequence* seq, const Sequence* betas, std::size_t num_literals, std::uint64_t& deps) {
+                key.clear();
+                deps = 0;
+                for (auto list : {seq, betas}) {
+                    for (auto cell = list; cell != nullptr; cell = cell->tail) {
+                        key.push_back(cell->head);
+                        deps |= cell->deps;
+                    }
+                }
+                std::sort(key.begin(), key.end());
+                key.push_back(UINT_MAX);
+                std::size_t middle = key.size();
+                for (std::size_t i = 0; i < num_literals; i++) {
+                    key.push_back(literals[i]);
+                    deps |= literal_deps[literals[i]];
+                }
+                std::sort(key.begin() + middle, key.end());
+            }
+
+            // Replaces the first formula with `first`, remembering to come
+            // back and replace it with `second` instead, and then with each
+            // formula in [`rest`, `rest_end`), negated if `negate_rest`. A
+            // branch that is in the memo is closed instead.
+            void branch(NodeId first, NodeId second, const NodeId* rest = nullptr, const NodeId* rest_end = nullptr, bool negate_rest = false) {
+                std::uint64_t hash = 0;
+                if (memo.enabled()) {
+                    hash = d_seq->hash + (betas != nullptr ? betas->hash : 0) + literal_hash;
+                    std::uint64_t deps;
+                    if (memo.may_contain(hash)) {
+                        build_key(d_seq, betas, literals.size(), deps);
+                        if (memo.contains(hash, key)) {
+                            closed++;
+                            is_fundamental = true;
+                            remembered = true;
+                            core = deps;
+                            return;
+                        }
+                    }
+                }
+
+                const Sequence* split = d_seq;
+                std::size_t level = depth();
+                std::uint64_t deps = d_seq->deps | level_bit(level);
+                d_seq = d_seq->tail;
+                ChoicePoint choice{d_seq, i_seq, betas, second, deps, cells.mark(), literals.size(), rest, rest_end, negate_rest};
+                if (pool != nullptr) {
+                    // Every branch is a task of its own, and the first one
+                    // goes on within the new rule
+                    context = SplitRef(context, level, 2 + std::size_t(rest_end - rest));
+                    search.splits.fetch_add(1, std::memory_order_relaxed);
+                    choice.split = context;
+                    choice.rest = choice.rest_end;
+                    for (auto it = rest_end; it != rest; ) {
+                        --it;
+                        choice.alternative = negate_rest ? nodes.negation(*it) : *it;
+                        pool->push(worker, choice);
+                    }
+                    choice.alternative = second;
+                    pool->push(worker, choice);
+                } else {
+                    levels.push_back({choice, 1 + std::size_t(rest_end - rest), 0, split, hash, closed});
+                }
+                d_seq = push(first, d_seq, deps);
+            }
+
+            // Branches once for each operand of an n-ary formula, negated
+            // if `negated`
+            void branch(NodeId op, bool negated) {
+                auto operands = nodes.operands(op);
+                NodeId first = operands[0];
+                NodeId second = operands[1];
+                if (negated) {
+                    first = nodes.negation(first);
+                    second = nodes.negation(second);
+                }
+                branch(first, second, operands.data() + 2, operands.data() + operands.size(), negated);
+            }
+
+            void record_literal(unsigned id, bool negated, std::uint64_t deps) {
+                auto& same = negated ? in_neg : in_pos;
+                if (!same[id]) {
+                    same.set(id);
+                    literals.push_back(2 * id + negated);
+                    literal_deps[2 * id + negated] = deps;
+                    literal_hash += literal_code(2 * id + negated);
+                }
+            }
+
+            // Moves the first formula, a literal of variable `id`, to the
+            // indecomposable side. The branch is fundamental as soon as it
+            // holds both a variable and its negation.
+            void add_literal(unsigned id, bool negated) {
+                std::uint64_t deps = d_seq->deps;
+                if (keep_i_seq)
+                    i_seq = push(d_seq->head, i_seq, deps);
+                d_seq = d_seq->tail;
+                if ((negated ? in_pos : in_neg)[id]) {
+                    is_fundamental = true;
+                    core = deps | literal_deps[2 * id + !negated];
+                    return;
+                }
+                record_literal(id, negated, deps);
+            }
+
+            // Whether `formula` needs a branching rule: AND, ~OR or
+            // ~IMPLIES
+            bool is_beta(NodeId formula) const {
+                if (nodes.kind(formula) == FormulaType::Unary) {
+                    NodeId sub_formula = nodes.right(formula);
+                    if (nodes.kind(sub_formula) == FormulaType::Binary)
+                        return nodes.token(sub_formula) == Token::Or or nodes.token(sub_formula) == Token::Implies;
+                    return nodes.kind(sub_formula) == FormulaType::Nary and nodes.token(sub_formula) == Token::Or;
+                }
+                return (nodes.kind(formula) == FormulaType::Binary or nodes.kind(formula) == FormulaType::Nary) and nodes.token(formula) == Token::And;
+            }
+
+            // Calls `visit(operand, negated)` for the formula that replaces
+            // the branching `formula` on each of its branches, in order:
+            // `operand`, negated if `negated`
+            template<typename Visit>
+            void for_each_alternative(NodeId formula, Visit visit) const {
+                if (nodes.kind(formula) == FormulaType::Binary) {
+                    visit(nodes.left(formula), false);
+                    visit(nodes.right(formula), false);
+                } else if (nodes.kind(formula) == FormulaType::Nary) {
+                    for (auto operand : nodes.operands(formula))
+                        visit(operand, false);
+                } else if (nodes.kind(nodes.right(formula)) == FormulaType::Binary) {
+                    NodeId op = nodes.right(formula);
+                    visit(nodes.left(op), nodes.token(op) != Token::Implies);
+                    visit(nodes.right(op), true);
+                } else {
+                    for (auto operand : nodes.operands(nodes.right(formula)))
+                        visit(operand, true);
+                }
+            }
+
+            // Applies the branching rule for `formula`, the first formula of
+            // d_seq. `swap` explores the second branch of a two-way rule
+            // first.
+            void split(NodeId formula, bool swap = false) {
+                if (nodes.kind(formula) == FormulaType::Nary) {
+                    branch(formula, false);
+                } else if (nodes.kind(formula) == FormulaType::Unary and nodes.kind(nodes.right(formula)) == FormulaType::Nary) {
+                    branch(nodes.right(formula), true);
+                } else {
+                    NodeId alternatives[2];
+                    unsigned count = 0;
+                    for_each_alternative(formula, [&](NodeId operand, bool negated) {
+                        alternatives[count++] = negated ? nodes.negation(operand) : operand;
+                    });
+                    branch(alternatives[swap], alternatives[!swap]);
+                }
+            }
+
+            // Whether `formula`, negated if `negated`, is a literal whose
+            // complement is already in the branch, so that adding it closes
+            // the branch straight away
+            bool closes(NodeId formula, bool negated) const {
+                if (nodes.kind(formula) == FormulaType::Unary) {
+                    formula = nodes.right(formula);
+                    negated = !negated;
+                }
+                if (nodes.kind(formula) != FormulaType::Atom)
+                    return false;
+                return (negated ? in_pos : in_neg)[nodes.token(formula).id()];
+            }
+
+            // Takes the branching formula to split on off `betas`: the one
+            // with the most branches that close immediately, then the
+            // largest. Of a two-way rule's branches, the one that closes, if
+            // only one does, goes first.
+            void split_beta() {
+                const Sequence* best = nullptr;
+                bool best_swap = false;
+                std::size_t best_closing = 0;
+                for (auto cell = betas; cell != nullptr; cell = cell->tail) {
+                    std::size_t closing = 0;
+                    std::size_t index = 0;
+                    bool swap = false;
+                    for_each_alternative(cell->head, [&](NodeId operand, bool negated) {
+                        if (closes(operand, negated)) {
+                            closing++;
+                            swap = index == 1 and closing == 1;
+                        }
+                        index++;
+                    });
+                    swap = swap and index == 2;
+                    if (best == nullptr or closing > best_closing or (closing == best_closing and nodes.tree_size(cell->head) > nodes.tree_size(best->head))) {
+                        best = cell;
+                        best_closing = closing;
+                        best_swap = swap;
+                    }
+                }
+
+                // Sequences are shared with pending choice points, so the
+                // cells in front of the chosen one are copied rather than
+                // unlinked
+                prefix.clear();
+                for (auto cell = betas; cell != best; cell = cell->tail)
+                    prefix.push_back(cell);
+                betas = best->tail;
+                for (auto it = prefix.rbegin(); it != prefix.rend(); ++it)
+                    betas = push((*it)->head, betas, (*it)->deps);
+
+                d_seq = push(best->head, d_seq, best->deps);
+                split(best->head, best_swap);
+            }
+
+            // Decomposes the current branch until it is fundamental or only
+            // indecomposable formulas remain
+            void decompose() {
+                bool alpha_first = search.options.schedule == Schedule::AlphaFirst;
+                while (!is_fundamental) {
+                    if (++steps == step_interval) {
+                        steps = 0;
+                        if (search.watchdog.expired(search.steps += step_interval)) {
+                            stopped = true;
+                            return;
+                        }
+                    }
+                    if (d_seq == nullptr) {
+                        if (betas == nullptr)
+                            break;
+                        split_beta();
+                        continue;
+                    }
+                    NodeId curr_formula = d_seq->head;
+                    // Formulas made by non-branching rules descend from
+                    // the same rules as the one they came from
+                    std::uint64_t deps = d_seq->deps;
+                    // Case: next formula needs a branching rule, and those
+                    // wait until no other rule applies
+                    if (alpha_first and is_beta(curr_formula)) {
+                        betas = push(curr_formula, betas, deps);
+                        d_seq = d_seq->tail;
+                        continue;
+                    }
+                    Token token = nodes.token(curr_formula);
+                    // Split into cases based on what the current formula type is
+                    switch (nodes.kind(curr_formula)) {
+                        // Case: next formula is a single variable - add to i_seq
+                        case FormulaType::Atom:
+                            add_literal(token.id(), false);
+                            break;
+                            // Case: next formula is the negation of something
+                        case FormulaType::Unary: {
+                            if (token == Token::Not) {
+                                NodeId sub_formula = nodes.right(curr_formula);
+                                Token sub_token = nodes.token(sub_formula);
+                                // Split into cases based on what is being negated
+                                switch (nodes.kind(sub_formula)) {
+                                    // Case: next formula is the negation of a variable - add to i_seq
+                                    case FormulaType::Atom:
+                                        add_literal(sub_token.id(), true);
+                                        break;
+                                        // Case: next formula is negation of a negation - cancel them
+                                    case FormulaType::Unary:
+                                        if (sub_token == Token::Not) {
+                                            d_seq = push(nodes.right(sub_formula), d_seq->tail, deps);
+                                        }
+                                        break;
+                                    // Case: next formula is negation of a binary operation
+                                    case FormulaType::Binary:
+                                        // Case: next formula is negation of AND
+                                        if (sub_token == Token::And) {
+                                            d_seq = push(nodes.negation(nodes.right(sub_formula)), d_seq->tail, deps);
+                                            d_seq = push(nodes.negation(nodes.left(sub_formula)), d_seq, deps);
+                                            // Case: next formula is negation of OR
+                                        } else if (sub_token == Token::Or) {
+                                            split(curr_formula);
+                                            // Case: next formula is negation of IMPLIES
+                                        } else if (sub_token == Token::Implies) {
+                                            split(curr_formula);
+                                        }
+                                        break;
+                                    // Case: next formula is negation of an n-ary operation
+                                    case FormulaType::Nary:
+                                        // Case: next formula is negation of AND - every operand, negated
+                                        if (sub_token == Token::And) {
+                                            auto operands = nodes.operands(sub_formula);
+                                            d_seq = d_seq->tail;
+                                            for (std::size_t i = operands.size(); i-- > 0;)
+                                                d_seq = push(nodes.negation(operands[i]), d_seq, deps);
+                                            // Case: next formula is negation of OR - one branch per operand
+                                        } else if (sub_token == Token::Or) {
+                                            split(curr_formula);
+                                        }
+                                        break;
+                                }
+                            }
+                            break;
+                        }
+                        // Case: next formula is a binary formula
+                        case FormulaType::Binary:
+                            // Case: next formula is an AND
+                            if (token == Token::And) {
+                                split(curr_formula);
+                                // Case: next formula is an OR
+                            } else if (token == Token::Or) {
+                                d_seq = push(nodes.right(curr_formula), d_seq->tail, deps);
+                                d_seq = push(nodes.left(curr_formula), d_seq, deps);
+                                // Case: next formula is an IMPLIES
+                            } else if (token == Token::Implies) {
+                                d_seq = push(nodes.right(curr_formula), d_seq->tail, deps);
+                                d_seq = push(nodes.negation(nodes.left(curr_formula)), d_seq, deps);
+                            }
+                            break;
+                        // Case: next formula is an n-ary formula
+                        case FormulaType::Nary:
+                            // Case: next formula is an AND - one branch per operand
+                            if (token == Token::And) {
+                                split(curr_formula);
+                                // Case: next formula is an OR - every operand
+                            } else if (token == Token::Or) {
+                                auto operands = nodes.operands(curr_formula);
+                                d_seq = d_seq->tail;
+                                for (std::size_t i = operands.size(); i-- > 0;)
+                                    d_seq = push(operands[i], d_seq, deps);
+                            }
+                            break;
+                    }
+                }
+            }
+
+            // Either a complementary pair closed the branch early, or the
+            // full indecomposable sequence was found and has none
+            void check_leaf() {
+                std::size_t i = ++search.leaves;
+                if (search.options.print_leaves) {
+                    leaf.clear();
+                    for (auto cell = i_seq; cell != nullptr; cell = cell->tail)
+                        leaf.push_back(cell->head);
+                    std::reverse(leaf.begin(), leaf.end());
+                    std::lock_guard<std::mutex> guard(search.print_lock);
+                    std::string& out = search.trace.buffer();
+                    out += "Leaf number ";
+                    out += std::to_string(i);
+                    out += ": ";
+                    Parser::print(search.symbols, nodes, leaf, out);
+                    out += is_fundamental ? " - fundamental\n" : " - not fundamental\n";
+                    if (!is_fundamental)
+                        out += "Full tree cannot be fundamental, terminating...\n";
+                    search.trace.commit();
+                }
+            }
+
+        public:
+            Prover(Search& search, work_stealing_pool<ChoicePoint>* pool = nullptr, unsigned worker = 0)
+                : search(search), nodes(search.factory.pool()), pool(pool), worker(worker),
+                  keep_i_seq(search.options.print_leaves or pool != nullptr),
+                  in_pos(search.factory.num_variables()), in_neg(search.factory.num_variables()),
+                  literal_deps(2 * search.factory.num_variables()),
+                  memo(pool == nullptr and !search.options.print_leaves ? search.options.memo_bytes : 0) {}
+
+            const transposition_table& memo_table() const {
+                return memo;
+            }
+
+            // Heap allocations made for sequence cells
+            std::size_t cell_chunks() const {
+                return cells.chunks();
+            }
+
+            ChoicePoint root(const std::vector<Formula*>& formulas) {
+                DecomposableSequence seq = nullptr;
+                for (auto it = formulas.rbegin(); it != formulas.rend(); ++it)
+                    seq = push((*it)->id, seq, 0);
+                return {seq, nullptr, nullptr, no_node, 0, cells.mark(), literals.size()};
+            }
+
+            // Explores the branch described by `choice`: its sequences with
+            // the alternative, if any, put back in front. Without a pool,
+            // carries on through every branch split off on the way. Returns
+            // false as soon as a leaf is not fundamental, or the limits end
+            // the search.
+            bool explore(const ChoicePoint& choice) {
+                if (pool != nullptr) {
+                    if (abandoned(choice.split.get())) {
+                        search.pruned++;
+                        return true;
                     }
+                    context = choice.split;
                 }
-                if ((in_pos & in_neg).any())
+                ChoicePoint curr = choice;
+                while (true) {
+                    std::size_t max_leaves = search.limits.max_leaves;
+                    if (max_leaves != 0 and search.leaves >= max_leaves)
+                        search.watchdog.stop(StopReason::Leaves);
+                    if (search.watchdog.expired(search.steps + steps))
+                        return false;
+                    cells.rewind(curr.cells);
+                    while (literals.size() > curr.literals) {
+                        unsigned literal = literals.back();
+                        literals.pop_back();
+                        literal_hash -= literal_code(literal);
+                        (literal & 1 ? in_neg : in_pos).reset(literal >> 1);
+                    }
+                    d_seq = curr.alternative != no_node ? push(curr.alternative, curr.d_seq, curr.deps) : curr.d_seq;
+                    i_seq = curr.i_seq;
+                    betas = curr.betas;
+                    is_fundamental = false;
+                    remembered = false;
+
+                    decompose();
+                    if (stopped)
+                        return false;
+                    if (!remembered) {
+                        closed++;
+                        check_leaf();
+                    }
+
+                    // If the most recent indecomposable sequence is not fundamental, stop
+                    if (!is_fundamental) {
+                        std::lock_guard<std::mutex> guard(search.open_leaf_lock);
+                        if (!search.found_open_leaf) {
+                            search.found_open_leaf = true;
+                            search.open_leaf = literals;
+                        }
+                        return false;
+                    }
+                    if (pool != nullptr) {
+                        finish(context.get(), core);
+                        context = nullptr;
+                        return true;
+                    }
+
+                    // Backtrack to the innermost level whose second branch
+                    // still matters. A closed first branch that did not use
+                    // its level's formula closes the second branch as well,
+                    // and both closed branches together descend from what
+                    // either one did, bar the level itself. Every branch
+                    // left behind is fundamental, and goes in the memo.
+                    while (true) {
+                        // Every leaf of this branch has been checked
+                        if (levels.empty())
+                            return true;
+                        Level& level = levels.back();
+                        std::size_t depth = levels.size() - 1;
+                        std::uint64_t bit = depth < 63 ? level_bit(depth) : 0;
+                        if (search.options.backjump and bit != 0 and !(core & bit)) {
+                            search.pruned += level.remaining;
+                        } else if (level.remaining > 0) {
+                            level.core |= core & ~bit;
+                            level.remaining--;
+                            curr = level.choice;
+                            if (level.remaining > 0) {
+                                ChoicePoint& next = level.choice;
+                                next.alternative = next.negate_rest ? nodes.negation(*next.rest) : *next.rest;
+                                next.rest++;
+                            }
+                            break;
+                        } else {
+                            core = (core | level.core) & ~bit;
+                        }
+                        if (memo.enabled() and closed - level.closed >= memo_min_closed) {
+                            std::uint64_t deps;
+                            build_key(level.split, level.choice.betas, level.choice.literals, deps);
+                            memo.insert(level.hash, key);
+                        }
+                        levels.pop_back();
+                    }
+                }
+            }
+
+            // Copies `seq` into this prover's arena
+            const Sequence* copy(const Sequence* seq) {
+                std::vector<const Sequence*> list;
+                for (auto cell = seq; cell != nullptr; cell = cell->tail)
+                    list.push_back(cell);
+                const Sequence* copy = nullptr;
+                for (auto it = list.rbegin(); it != list.rend(); ++it)
+                    copy = push((*it)->head, copy, (*it)->deps);
+                return copy;
+            }
+
+            // Takes over a branch split off by another worker. Its sequences
+            // live in that worker's arena, so they are copied into this one,
+            // and this prover's bitsets are rebuilt from the copied i_seq.
+            void adopt(ChoicePoint& choice) {
+                if (abandoned(choice.split.get()))
+                    return;
+                cells.rewind(arena::position{});
+                literals.clear();
+                literal_hash = 0;
+                in_pos.reset();
+                in_neg.reset();
+
+                choice.d_seq = copy(choice.d_seq);
+                choice.betas = copy(choice.betas);
+                choice.i_seq = copy(choice.i_seq);
+                for (auto cell = choice.i_seq; cell != nullptr; cell = cell->tail) {
+                    NodeId formula = cell->head;
+                    if (nodes.kind(formula) == FormulaType::Atom)
+                        record_literal(nodes.token(formula).id(), false, cell->deps);
+                    else
+                        record_literal(nodes.token(nodes.right(formula)).id(), true, cell->deps);
+                }
+                choice.cells = cells.mark();
+                choice.literals = literals.size();
+            }
+        };
+
+        // `search_chunks` are the heap allocations made by the search itself,
+        // apart from formula nodes
+        void record_statistics(Statistics* stats, const FormulaFactory& factory, std::size_t parsed_nodes, std::size_t parsed_chunks, std::size_t search_chunks = 0) {
+            if (stats == nullptr)
+                return;
+            stats->formula_nodes = factory.nodes.allocations();
+            stats->formula_bytes = factory.nodes.bytes();
+            stats->formula_chunks = factory.nodes.chunks();
+            stats->formula_pool_bytes = factory.pool().bytes();
+            stats->decomposition_nodes = stats->formula_nodes - parsed_nodes;
+            stats->decomposition_chunks = stats->formula_chunks - parsed_chunks + search_chunks;
+        }
+
+        // Inputs shorter than this in all are read on the calling thread.
+        // Only tokenizing is shared out, so smaller inputs do not pay for
+        // starting the threads.
+        constexpr std::size_t min_parallel_bytes = 1 << 20;
+
+        // A run of consecutive input formulas, tokenized by one worker with
+        // variables numbered by a symbol table of its own. The first run is
+        // parsed straight into the caller's table and factory instead.
+        struct Chunk {
+            SymbolTable symbols;
+            std::vector<Token> tokens;
+            // Formula `i` of the run is tokens[ends[i - 1], ends[i])
+            std::vector<std::size_t> ends;
+            std::vector<Formula*> formulas;
+            // The error that ended the run early, if any
+            std::exception_ptr error;
+        };
+
+        // Reads `num_runs` runs of formulas into `factory`, with variables
+        // numbered by `symbols`, and returns the formulas that are not
+        // empty. `read_run(i, read)` calls `read(formula)` with the text of
+        // each formula of run `i`. The first run is parsed while the others
+        // are tokenized, at the same time on `pool`. The other runs'
+        // variables are then added to `symbols` in input order, their
+        // tokens renumbered to match, and their formulas built from the
+        // tokens on one thread, so that ids end up the same as when parsing
+        // on one thread and every node is only hashed once.
+        template<typename ReadRun>
+        std::vector<Formula*> read_runs(std::size_t num_runs, SymbolTable& symbols, FormulaFactory& factory, work_stealing_pool<std::size_t>& pool, ReadRun read_run) {
+            std::vector<Formula*> formulas;
+            if (num_runs == 1) {
+                read_run(0, [&](std::string_view formula) {
+                    formulas.push_back(Parser::parse(formula, symbols, factory));
+                });
+                std::erase(formulas, nullptr);
+                return formulas;
+            }
+
+            std::deque<Chunk> chunks(num_runs);
+            std::vector<std::size_t> roots;
+            for (std::size_t i = 0; i < chunks.size(); i++)
+                roots.push_back(i);
+            pool.run(roots, [&](unsigned, std::size_t& i) {
+                Chunk& chunk = chunks[i];
+                try {
+                    if (i == 0) {
+                        read_run(i, [&](std::string_view formula) {
+                            chunk.formulas.push_back(Parser::parse(formula, symbols, factory));
+                        });
+                        return;
+                    }
+                    read_run(i, [&](std::string_view formula) {
+                        Tokenizer::Scanner scanner(formula, chunk.symbols);
+                        Token token = Token::LParen;
+                        while (scanner.next(token))
+                            chunk.tokens.push_back(token);
+                        chunk.ends.push_back(chunk.tokens.size());
+                    });
+                } catch (...) {
+                    chunk.error = std::current_exception();
+                }
+            });
+
+            // Errors are raised in input order, so the first bad formula is
+            // the one reported, as it would be on one thread
+            std::vector<Token> variables;
+            for (std::size_t i = 0; i < chunks.size(); i++) {
+                Chunk& chunk = chunks[i];
+                if (i > 0) {
+                    variables.clear();
+                    for (unsigned id = 0; id < chunk.symbols.num_variables(); id++)
+                        variables.push_back(symbols.variable(chunk.symbols.name(Token::Variable(id))));
+                    for (auto& token : chunk.tokens)
+                        if (token.is_variable())
+                            token = variables[token.id()];
+                    std::span<const Token> tokens = chunk.tokens;
+                    std::size_t begin = 0;
+                    for (auto end : chunk.ends) {
+                        chunk.formulas.push_back(Parser::parse(tokens.subspan(begin, end - begin), factory));
+                        begin = end;
+                    }
+                    std::vector<Token>().swap(chunk.tokens);
+                }
+                if (chunk.error)
+                    std::rethrow_exception(chunk.error);
+                for (auto formula : chunk.formulas)
+                    if (formula != nullptr)
+                        formulas.push_back(formula);
+            }
+            return formulas;
+        }
+
+        // Parses each of `str_formulas`. Given more than one thread, the
+        // list is cut into runs of about the same length in bytes.
+        std::vector<Formula*> read_formulas(std::span<const std::string_view> str_formulas, SymbolTable& symbols, FormulaFactory& factory, unsigned threads) {
+            std::size_t bytes = 0;
+            for (auto str_formula : str_formulas)
+                bytes += str_formula.size();
+
+            work_stealing_pool<std::size_t> pool(threads);
+            std::vector<std::span<const std::string_view>> runs;
+            if (pool.size() == 1 or str_formulas.size() < 2 or bytes < min_parallel_bytes) {
+                runs.push_back(str_formulas);
+            } else {
+                std::size_t begin = 0;
+                std::size_t taken = 0;
+                for (std::size_t i = 0; i < str_formulas.size(); i++) {
+                    taken += str_formulas[i].size();
+                    if (taken * pool.size() >= bytes * (runs.size() + 1) or i + 1 == str_formulas.size()) {
+                        runs.push_back(str_formulas.subspan(begin, i + 1 - begin));
+                        begin = i + 1;
+                    }
+                }
+            }
+            return read_runs(runs.size(), symbols, factory, pool, [&](std::size_t i, auto read) {
+                for (auto str_formula : runs[i])
+                    read(str_formula);
+            });
+        }
+
+        // Calls `f` with each line of `text`, without the line break
+        template<typename F>
+        void for_each_line(std::string_view text, F f) {
+            while (!text.empty()) {
+                std::size_t end = text.find('\n');
+                std::string_view line = text.substr(0, end);
+                if (!line.empty() and line.back() == '\r')
+                    line.remove_suffix(1);
+                f(line);
+                if (end == std::string_view::npos)
                     break;
+                text.remove_prefix(end + 1);
             }
+        }
+
+        // Text is handed to `release` in pieces of at least this size
+        constexpr std::size_t release_bytes = 1 << 20;
 
-            is_fundamental = (in_pos & in_neg).any();
-            if (print_leaves) {
-                std::cout << "Leaf number " << i << ": " << Parser::to_str(i_seq) << " - " << (is_fundamental ? "fundamental" : "not fundamental") << std::endl;
-                if (!is_fundamental)
-                    std::cout << "Full tree cannot be fundamental, terminating..." << std::endl;
+        // Parses each line of `text` as a formula, straight from the text.
+        // Given more than one thread, the text is cut into runs of about
+        // the same length at line breaks. Each run's text is passed to
+        // `release(part)` a part at a time once it has been parsed.
+        template<typename Release>
+        std::vector<Formula*> read_lines(std::string_view text, SymbolTable& symbols, FormulaFactory& factory, unsigned threads, Release release) {
+            work_stealing_pool<std::size_t> pool(threads);
+            std::vector<std::string_view> runs;
+            if (pool.size() == 1 or text.size() < min_parallel_bytes) {
+                runs.push_back(text);
+            } else {
+                std::size_t begin = 0;
+                for (unsigned i = 1; i <= pool.size() and begin < text.size(); i++) {
+                    std::size_t end = text.size();
+                    if (i < pool.size()) {
+                        end = text.find('\n', std::max(begin, text.size() / pool.size() * i));
+                        end = end == std::string_view::npos ? text.size() : end + 1;
+                    }
+                    runs.push_back(text.substr(begin, end - begin));
+                    begin = end;
+                }
             }
+            return read_runs(runs.size(), symbols, factory, pool, [&](std::size_t i, auto read) {
+                const char* released = runs[i].data();
+                for_each_line(runs[i], [&](std::string_view line) {
+                    read(line);
+                    const char* read = line.data() + line.size();
+                    if ((std::size_t)(read - released) >= release_bytes) {
+                        release(std::string_view(released, read - released));
+                        released = read;
+                    }
+                });
+            });
+        }
+    }
 
-            // If the most recent indecomposable sequence is not fundamental, return false
-            if (!(in_pos & in_neg).any())
-                return false;
+    // Decides formulas already read into `factory`, with their variables
+    // numbered by the session's symbol table, unless `limits` stop it first
+    Result check(Session& session, FormulaFactory& factory, std::vector<Formula*> formulas, const Options& options, const Limits& limits = {}) {
+        Result result;
+        Statistics* stats = &result.stats;
+        Watchdog watchdog(limits);
+        auto stop = watchdog.callback();
+        // Variables an engine does not set are left false
+        result.counterexample.assign(session.symbols.num_variables(), false);
+        auto decided = [&](bool is_tautology) {
+            result.verdict = is_tautology ? Verdict::Tautology : Verdict::NotTautology;
+            if (is_tautology)
+                result.counterexample.clear();
+            return result;
+        };
+        auto gave_up = [&]() {
+            result.verdict = Verdict::Unknown;
+            result.stopped = watchdog.stopped();
+            result.counterexample.clear();
+            return result;
+        };
+        if (watchdog.expired(0))
+            return gave_up();
 
-            // Go to next sequence if there is one
-            ++curr_seq_it;
-            break_outer:;
+        if (options.preprocess) {
+            auto simplified = Preprocess::simplify(factory, formulas);
+            stats->preprocess_nodes_before = simplified.nodes_before;
+            stats->preprocess_nodes_after = simplified.nodes_after;
+            stats->preprocess_size_before = simplified.size_before;
+            stats->preprocess_size_after = simplified.size_after;
+            if (simplified.is_tautology) {
+                record_statistics(stats, factory, factory.nodes.allocations(), factory.nodes.chunks());
+                return decided(true);
+            }
+            formulas = std::move(simplified.formulas);
+        }
+        Engine engine = options.engine;
+        if (engine == Engine::Auto or engine == Engine::TruthTable) {
+            auto program = TruthTable::compile(factory, formulas);
+            engine = choose_engine(factory, formulas, options, program);
+            if (engine == Engine::TruthTable) {
+                auto table = TruthTable::check(program, options.threads, stop);
+                record_statistics(stats, factory, factory.nodes.allocations(), factory.nodes.chunks());
+                stats->engine = engine;
+                stats->assignments = table.assignments;
+                if (table.stopped)
+                    return gave_up();
+                for (std::size_t i = 0; i < table.counterexample.size(); i++)
+                    result.counterexample[program.variables[i].id()] = table.counterexample[i];
+                return decided(table.is_tautology);
+            }
+        }
+        if (engine == Engine::SAT) {
+            // The formula is a tautology exactly when its negation has no model
+            SAT::Solver solver;
+            auto encoding = SAT::encode_negation(solver, factory, formulas);
+            auto satisfiable = solver.solve(stop);
+            record_statistics(stats, factory, factory.nodes.allocations(), factory.nodes.chunks());
+            stats->engine = engine;
+            stats->conflicts = solver.conflicts;
+            stats->decisions = solver.decisions;
+            if (!satisfiable.has_value())
+                return gave_up();
+            if (*satisfiable)
+                for (std::size_t i = 0; i < encoding.atoms.size(); i++)
+                    result.counterexample[encoding.atoms[i].id()] = solver.model(encoding.atom_vars[i]);
+            return decided(!*satisfiable);
+        }
+        if (engine == Engine::BDD) {
+            BDD::Manager manager(BDD::appearance_order(factory, formulas));
+            auto root = manager.build(factory, formulas, stop);
+            record_statistics(stats, factory, factory.nodes.allocations(), factory.nodes.chunks());
+            auto bdd_stats = manager.statistics();
+            stats->engine = engine;
+            stats->bdd_nodes = bdd_stats.nodes;
+            stats->bdd_bytes = bdd_stats.bytes;
+            if (!root.has_value())
+                return gave_up();
+            if (*root != BDD::one) {
+                auto path = manager.path_to(*root, BDD::zero);
+                for (std::size_t level = 0; level < path.size(); level++)
+                    result.counterexample[manager.variables()[level].id()] = path[level];
+            }
+            return decided(*root == BDD::one);
         }
-        return true;
+
+        // The negations the rules need are all built up front, and count
+        // as made while decomposing
+        std::size_t parsed_nodes = factory.nodes.allocations();
+        std::size_t parsed_chunks = factory.nodes.chunks();
+        prepare_negations(factory, formulas);
+
+        Search search(factory, session.symbols, options, limits, watchdog);
+        std::size_t steals = 0;
+        std::size_t search_chunks = 0;
+        if (options.threads == 1) {
+            Prover prover(search);
+            prover.explore(prover.root(formulas));
+            search_chunks = prover.cell_chunks();
+            stats->memo_hits = prover.memo_table().hits();
+            stats->memo_entries = prover.memo_table().size();
+            stats->memo_evictions = prover.memo_table().evictions();
+        } else {
+            work_stealing_pool<ChoicePoint> pool(options.threads);
+            std::deque<Prover> provers;
+            for (unsigned id = 0; id < pool.size(); id++)
+                provers.emplace_back(search, &pool, id);
+
+            // The first leaf that is not fundamental decides the answer, so
+            // every other worker can stop, as they can once a limit is
+            // reached
+            pool.run({provers[0].root(formulas)},
+                [&](unsigned id, ChoicePoint& choice) {
+                    if (!provers[id].explore(choice))
+                        pool.cancel();
+                },
+                [&](unsigned id, ChoicePoint& choice) {
+                    provers[id].adopt(choice);
+                });
+            steals = pool.steals();
+            search_chunks = search.splits;
+            for (const Prover& prover : provers)
+                search_chunks += prover.cell_chunks();
+        }
+        search.trace.flush();
+
+        record_statistics(stats, factory, parsed_nodes, parsed_chunks, search_chunks);
+        stats->leaves = search.leaves;
+        stats->steals = steals;
+        stats->pruned = search.pruned;
+        stats->engine = Engine::RS;
+        // A leaf that is not fundamental decides the check even if a limit
+        // was reached while it was being found
+        if (search.found_open_leaf) {
+            // Every literal of the leaf is made false
+            for (unsigned literal : search.open_leaf)
+                result.counterexample[literal >> 1] = literal & 1;
+            return decided(false);
+        }
+        if (watchdog.stopped() != StopReason::None)
+            return gave_up();
+        return decided(true);
+    }
+
+    // Whether the two formulas have the same truth value under every
+    // assignment. Both are built into one BDD manager, where equivalent
+    // formulas always end up as the same node.
+    bool are_equivalent(std::string_view a, std::string_view b) {
+        SymbolTable symbols;
+        FormulaFactory factory;
+        Formula* formula_a = Parser::parse(a, symbols, factory);
+        Formula* formula_b = Parser::parse(b, symbols, factory);
+        if (formula_a == nullptr or formula_b == nullptr)
+            return formula_a == formula_b;
+        BDD::Manager manager(BDD::appearance_order(factory, {formula_a, formula_b}));
+        return manager.build(factory, {formula_a}) == manager.build(factory, {formula_b});
+    }
+
+    Result check(Session& session, std::span<const std::string_view> str_formulas, const Options& options, const Limits& limits = {}) {
+        session.reset();
+        // Every formula node made for this check lives in the factory's
+        // arena, and is released in bulk when the check returns
+        FormulaFactory factory;
+        std::vector<Formula*> formulas = read_formulas(str_formulas, session.symbols, factory, options.threads);
+        return check(session, factory, std::move(formulas), options, limits);
+    }
+
+    // Decides the formulas written one per line in `text`, joined by `v`.
+    // Lines are parsed where they are, without being copied, and blank
+    // lines are skipped.
+    Result check_lines(Session& session, std::string_view text, const Options& options, const Limits& limits = {}) {
+        session.reset();
+        FormulaFactory factory;
+        std::vector<Formula*> formulas = read_lines(text, session.symbols, factory, options.threads, [](std::string_view) {});
+        return check(session, factory, std::move(formulas), options, limits);
+    }
+
+    // The same, for the lines of a mapped file. Pages are let go as soon
+    // as they have been parsed, so that memory is taken up by the formulas
+    // rather than their text.
+    Result check_lines(Session& session, const mapped_file& file, const Options& options, const Limits& limits = {}) {
+        session.reset();
+        FormulaFactory factory;
+        std::vector<Formula*> formulas = read_lines(file.text(), session.symbols, factory, options.threads, [&](std::string_view part) {
+            file.release(part);
+        });
+        return check(session, factory, std::move(formulas), options, limits);
+    }
+
+    namespace {
+        // The answer to a check without limits, which is never unknown
+        bool report(Result result, Statistics* stats) {
+            if (stats != nullptr)
+                *stats = result.stats;
+            return result.verdict == Verdict::Tautology;
+        }
+    }
+
+    bool is_tautology(Session& session, std::span<const std::string_view> str_formulas, const Options& options, Statistics* stats = nullptr) {
+        return report(check(session, str_formulas, options), stats);
+    }
+
+    bool is_tautology_lines(Session& session, std::string_view text, const Options& options, Statistics* stats = nullptr) {
+        return report(check_lines(session, text, options), stats);
+    }
+
+    bool is_tautology_lines(Session& session, const mapped_file& file, const Options& options, Statistics* stats = nullptr) {
+        return report(check_lines(session, file, options), stats);
+    }
+
+    bool is_tautology(Session& session, const FormulaStrings& str_formulas, const Options& options, Statistics* stats = nullptr) {
+        std::vector<std::string_view> views(str_formulas.begin(), str_formulas.end());
+        return is_tautology(session, views, options, stats);
+    }
+
+    // Checks in a session of its own
+    bool is_tautology(std::span<const std::string_view> str_formulas, const Options& options, Statistics* stats = nullptr) {
+        Session session;
+        return is_tautology(session, str_formulas, options, stats);
+    }
+
+    bool is_tautology(const FormulaStrings& str_formulas, const Options& options, Statistics* stats = nullptr) {
+        Session session;
+        return is_tautology(session, str_formulas, options, stats);
+    }
+
+    bool is_tautology(const FormulaStrings& str_formulas, bool print_leaves = false, Statistics* stats = nullptr) {
+        Options options;
+        options.print_leaves = print_leaves;
+        return is_tautology(str_formulas, options, stats);
     }
 }
 
 #endif
-
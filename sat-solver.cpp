@@ -0,0 +1,622 @@
+#ifndef SAT_SAT_SOLVER_CPP
+#define SAT_SAT_SOLVER_CPP
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+#include "parser.cpp"
+
+// A conflict-driven clause learning SAT solver, and the Tseitin encoding
+// that turns "is this formula a tautology" into "is its negation
+// unsatisfiable".
+namespace SAT {
+    using Parser::Formula;
+    using Parser::UnaryFormula;
+    using Parser::BinaryFormula;
+    using Parser::NaryFormula;
+    using Parser::FormulaType;
+    using Parser::FormulaFactory;
+
+    using Tokenizer::Token;
+
+    // Variable `v` is the literal `2*v`, and its negation `2*v + 1`
+    using Var = unsigned;
+    using Lit = unsigned;
+
+    inline Lit make_lit(Var var, bool negated = false) {
+        return 2 * var + negated;
+    }
+
+    inline Var var_of(Lit lit) {
+        return lit >> 1;
+    }
+
+    inline bool is_negated(Lit lit) {
+        return lit & 1;
+    }
+
+    inline Lit negation(Lit lit) {
+        return lit ^ 1;
+    }
+
+    class Solver {
+        static constexpr unsigned none = static_cast<unsigned>(-1);
+
+        enum Value : unsigned char {
+            False = 0,
+            True = 1,
+            Undef = 2
+        };
+
+        struct Clause {
+            std::vector<Lit> lits;
+            bool learnt;
+            bool deleted;
+            double activity;
+        };
+
+        // A clause watching a literal, along with one of its other literals.
+        // When the blocker is already true the clause need not be visited.
+        struct Watcher {
+            unsigned clause;
+            Lit blocker;
+        };
+
+        std::vector<Clause> clauses;
+        std::vector<unsigned> learnts;
+        // Clauses to visit when a literal becomes false, indexed by literal
+        std::vector<std::vector<Watcher>> watches;
+
+        std::vector<Value> values;
+        std::vector<unsigned> levels;
+        std::vector<unsigned> reasons;
+        std::vector<bool> phases;
+        std::vector<Lit> trail;
+        std::vector<std::size_t> trail_limits;
+        std::size_t propagated = 0;
+        // Set when a clause that is false at level 0 has been added
+        bool inconsistent = false;
+
+        // VSIDS: variable activities, and a binary max-heap of the
+        // unassigned variables ordered by them
+        std::vector<double> activity;
+        double activity_step = 1;
+        std::vector<Var> heap;
+        std::vector<unsigned> heap_index;
+
+        double clause_step = 1;
+
+        // Scratch space for conflict analysis
+        std::vector<bool> seen;
+        std::vector<Lit> to_clear;
+
+        std::vector<bool> model_values;
+
+        Value value(Lit lit) const {
+            Value v = values[var_of(lit)];
+            return v == Undef ? Undef : Value(v ^ is_negated(lit));
+        }
+
+        unsigned level() const {
+            return trail_limits.size();
+        }
+
+        // Heap
+
+        bool heap_less(Var a, Var b) const {
+            return activity[a] > activity[b];
+        }
+
+        void heap_up(unsigned i) {
+            Var var = heap[i];
+            while (i > 0 and heap_less(var, heap[(i - 1) / 2])) {
+                heap[i] = heap[(i - 1) / 2];
+                heap_index[heap[i]] = i;
+                i = (i - 1) / 2;
+            }
+            heap[i] = var;
+            heap_index[var] = i;
+        }
+
+        void heap_down(unsigned i) {
+            Var var = heap[i];
+            while (2 * i + 1 < heap.size()) {
+                unsigned child = 2 * i + 1;
+                if (child + 1 < heap.size() and heap_less(heap[child + 1], heap[child]))
+                    child++;
+                if (!heap_less(heap[child], var))
+                    break;
+                heap[i] = heap[child];
+                heap_index[heap[i]] = i;
+                i = child;
+            }
+            heap[i] = var;
+            heap_index[var] = i;
+        }
+
+        void heap_insert(Var var) {
+            if (heap_index[var] != none)
+                return;
+            heap.push_back(var);
+            heap_up(heap.size() - 1);
+        }
+
+        Var heap_pop() {
+            Var top = heap[0];
+            heap_index[top] = none;
+            Var last = heap.back();
+            heap.pop_back();
+            if (!heap.empty()) {
+                heap[0] = last;
+                heap_down(0);
+            }
+            return top;
+        }
+
+        void bump_variable(Var var) {
+            if ((activity[var] += activity_step) > 1e100) {
+                for (auto& a : activity)
+                    a *= 1e-100;
+                activity_step *= 1e-100;
+            }
+            if (heap_index[var] != none)
+                heap_up(heap_index[var]);
+        }
+
+        void bump_clause(Clause& clause) {
+            if ((clause.activity += clause_step) > 1e20) {
+                for (auto c : learnts)
+                    clauses[c].activity *= 1e-20;
+                clause_step *= 1e-20;
+            }
+        }
+
+        // Search
+
+        void assign(Lit lit, unsigned reason) {
+            Var var = var_of(lit);
+            values[var] = Value(!is_negated(lit));
+            levels[var] = level();
+            reasons[var] = reason;
+            trail.push_back(lit);
+        }
+
+        void watch(unsigned c) {
+            const auto& lits = clauses[c].lits;
+            watches[negation(lits[0])].push_back({c, lits[1]});
+            watches[negation(lits[1])].push_back({c, lits[0]});
+        }
+
+        // Unit propagation over the two watched literals of each clause.
+        // Returns a clause made false by the assignment, or `none`.
+        unsigned propagate() {
+            while (propagated < trail.size()) {
+                Lit lit = trail[propagated++];
+                Lit false_lit = negation(lit);
+                auto& list = watches[lit];
+                std::size_t i = 0, j = 0;
+                while (i < list.size()) {
+                    Watcher w = list[i++];
+                    if (value(w.blocker) == True) {
+                        list[j++] = w;
+                        continue;
+                    }
+                    Clause& clause = clauses[w.clause];
+                    if (clause.deleted)
+                        continue;
+                    auto& lits = clause.lits;
+                    // Keep the false literal in the second slot
+                    if (lits[0] == false_lit)
+                        std::swap(lits[0], lits[1]);
+                    Lit first = lits[0];
+                    if (first != w.blocker and value(first) == True) {
+                        list[j++] = {w.clause, first};
+                        continue;
+                    }
+                    // Look for a new literal to watch
+                    bool moved = false;
+                    for (std::size_t k = 2; k < lits.size(); k++) {
+                        if (value(lits[k]) != False) {
+                            std::swap(lits[1], lits[k]);
+                            watches[negation(lits[1])].push_back({w.clause, first});
+                            moved = true;
+                            break;
+                        }
+                    }
+                    if (moved)
+                        continue;
+                    list[j++] = {w.clause, first};
+                    if (value(first) == False) {
+                        while (i < list.size())
+                            list[j++] = list[i++];
+                        list.resize(j);
+                        propagated = trail.size();
+                        return w.clause;
+                    }
+                    assign(first, w.clause);
+                }
+                list.resize(j);
+            }
+            return none;
+        }
+
+        // First-UIP conflict analysis. Fills `learnt` with the learnt
+        // clause, asserting literal first, and returns the level to
+        // backtrack to.
+        unsigned analyze(unsigned conflict, std::vector<Lit>& learnt) {
+            learnt.clear();
+            learnt.push_back(0);
+            unsigned pending = 0;
+            Lit lit = 0;
+            bool first = true;
+            std::size_t index = trail.size();
+            do {
+                Clause& clause = clauses[conflict];
+                if (clause.learnt)
+                    bump_clause(clause);
+                for (std::size_t k = first ? 0 : 1; k < clause.lits.size(); k++) {
+                    Lit q = clause.lits[k];
+                    Var var = var_of(q);
+                    if (seen[var] or levels[var] == 0)
+                        continue;
+                    seen[var] = true;
+                    bump_variable(var);
+                    if (levels[var] == level())
+                        pending++;
+                    else
+                        learnt.push_back(q);
+                }
+                // Next literal on the trail that took part in the conflict
+                while (!seen[var_of(trail[--index])]);
+                lit = trail[index];
+                conflict = reasons[var_of(lit)];
+                seen[var_of(lit)] = false;
+                pending--;
+                first = false;
+            } while (pending > 0);
+            learnt[0] = negation(lit);
+
+            // Drop literals implied by the rest of the clause
+            to_clear.assign(learnt.begin() + 1, learnt.end());
+            std::size_t j = 1;
+            for (std::size_t i = 1; i < learnt.size(); i++) {
+                unsigned reason = reasons[var_of(learnt[i])];
+                bool redundant = reason != none;
+                if (redundant) {
+                    for (std::size_t k = 1; k < clauses[reason].lits.size(); k++) {
+                        Var var = var_of(clauses[reason].lits[k]);
+                        if (!seen[var] and levels[var] > 0) {
+                            redundant = false;
+                            break;
+                        }
+                    }
+                }
+                if (!redundant)
+                    learnt[j++] = learnt[i];
+            }
+            for (Lit q : to_clear)
+                seen[var_of(q)] = false;
+            learnt.resize(j);
+
+            // Backtrack to the second highest level in the clause, which is
+            // moved to the second slot to be watched
+            unsigned back_level = 0;
+            if (learnt.size() > 1) {
+                std::size_t max = 1;
+                for (std::size_t i = 2; i < learnt.size(); i++)
+                    if (levels[var_of(learnt[i])] > levels[var_of(learnt[max])])
+                        max = i;
+                std::swap(learnt[1], learnt[max]);
+                back_level = levels[var_of(learnt[1])];
+            }
+            return back_level;
+        }
+
+        void backtrack(unsigned to_level) {
+            if (level() <= to_level)
+                return;
+            for (std::size_t i = trail.size(); i-- > trail_limits[to_level];) {
+                Var var = var_of(trail[i]);
+                phases[var] = is_negated(trail[i]);
+                values[var] = Undef;
+                reasons[var] = none;
+                heap_insert(var);
+            }
+            trail.resize(trail_limits[to_level]);
+            trail_limits.resize(to_level);
+            propagated = trail.size();
+        }
+
+        // Deletes the less active half of the learnt clauses that are not
+        // currently the reason for an assignment
+        void reduce_learnts() {
+            std::sort(learnts.begin(), learnts.end(), [&](unsigned a, unsigned b) {
+                return clauses[a].activity < clauses[b].activity;
+            });
+            std::size_t j = 0;
+            for (std::size_t i = 0; i < learnts.size(); i++) {
+                Clause& clause = clauses[learnts[i]];
+                Var first = var_of(clause.lits[0]);
+                bool locked = reasons[first] == learnts[i] and value(clause.lits[0]) == True;
+                if (i < learnts.size() / 2 and !locked and clause.lits.size() > 2) {
+                    clause.deleted = true;
+                    clause.lits.clear();
+                    clause.lits.shrink_to_fit();
+                } else {
+                    learnts[j++] = learnts[i];
+                }
+            }
+            learnts.resize(j);
+            // Drop the watchers of deleted clauses
+            for (auto& list : watches)
+                list.erase(std::remove_if(list.begin(), list.end(), [&](const Watcher& w) {
+                    return clauses[w.clause].deleted;
+                }), list.end());
+        }
+
+        // The Luby restart sequence: 1 1 2 1 1 2 4 1 1 2 ...
+        static double luby(double y, unsigned x) {
+            unsigned size = 1, seq = 0;
+            while (size < x + 1) {
+                seq++;
+                size = 2 * size + 1;
+            }
+            while (size - 1 != x) {
+                size = (size - 1) >> 1;
+                seq--;
+                x = x % size;
+            }
+            double res = 1;
+            while (seq-- > 0)
+                res *= y;
+            return res;
+        }
+
+    public:
+        std::uint64_t conflicts = 0;
+        std::uint64_t decisions = 0;
+        std::uint64_t propagations = 0;
+        std::uint64_t restarts = 0;
+
+        Var new_var() {
+            Var var = values.size();
+            values.push_back(Undef);
+            levels.push_back(0);
+            reasons.push_back(none);
+            phases.push_back(true);
+            activity.push_back(0);
+            heap_index.push_back(none);
+            seen.push_back(false);
+            watches.emplace_back();
+            watches.emplace_back();
+            heap_insert(var);
+            return var;
+        }
+
+        unsigned num_vars() const {
+            return values.size();
+        }
+
+        std::size_t num_clauses() const {
+            return clauses.size() - learnts.size();
+        }
+
+        // Adds a clause before solving. Returns false if the clauses are
+        // already known to be unsatisfiable.
+        bool add_clause(std::vector<Lit> lits) {
+            if (inconsistent)
+                return false;
+            std::sort(lits.begin(), lits.end());
+            std::size_t j = 0;
+            for (std::size_t i = 0; i < lits.size(); i++) {
+                // Satisfied, or a tautology: the clause can be dropped
+                if (value(lits[i]) == True or (i > 0 and lits[i] == negation(lits[i-1])))
+                    return true;
+                if (value(lits[i]) == False or (j > 0 and lits[i] == lits[j-1]))
+                    continue;
+                lits[j++] = lits[i];
+            }
+            lits.resize(j);
+            if (lits.empty()) {
+                inconsistent = true;
+                return false;
+            }
+            if (lits.size() == 1) {
+                assign(lits[0], none);
+                if (propagate() != none)
+                    inconsistent = true;
+                return !inconsistent;
+            }
+            clauses.push_back({std::move(lits), false, false, 0});
+            watch(clauses.size() - 1);
+            return true;
+        }
+
+        // Decides whether the clauses have a satisfying assignment. Every so
+        // often, and at each restart, `stop` is called with the number of
+        // conflicts so far, and the search gives up, with no answer, if it
+        // returns true.
+        std::optional<bool> solve(const std::function<bool(std::uint64_t)>& stop) {
+            if (inconsistent)
+                return false;
+            std::vector<Lit> learnt;
+            double max_learnts = std::max<double>(num_clauses() / 3.0, 1000);
+            for (unsigned restart = 0;; restart++) {
+                std::uint64_t budget = 100 * luby(2, restart);
+                std::uint64_t local_conflicts = 0;
+                while (true) {
+                    std::size_t before = trail.size();
+                    unsigned conflict = propagate();
+                    propagations += trail.size() - before;
+                    if (conflict != none) {
+                        conflicts++;
+                        local_conflicts++;
+                        if (level() == 0)
+                            return false;
+                        if (stop and conflicts % 64 == 0 and stop(conflicts)) {
+                            backtrack(0);
+                            return std::nullopt;
+                        }
+                        unsigned back_level = analyze(conflict, learnt);
+                        backtrack(back_level);
+                        if (learnt.size() == 1) {
+                            assign(learnt[0], none);
+                        } else {
+                            clauses.push_back({learnt, true, false, 0});
+                            unsigned c = clauses.size() - 1;
+                            learnts.push_back(c);
+                            bump_clause(clauses[c]);
+                            watch(c);
+                            assign(learnt[0], c);
+                        }
+                        activity_step /= 0.95;
+                        clause_step /= 0.999;
+                        continue;
+                    }
+                    if (local_conflicts >= budget) {
+                        restarts++;
+                        backtrack(0);
+                        if (stop and stop(conflicts))
+                            return std::nullopt;
+                        break;
+                    }
+                    if (learnts.size() >= max_learnts + trail.size()) {
+                        reduce_learnts();
+                        max_learnts *= 1.1;
+                    }
+                    // Pick the most active unassigned variable
+                    Var next = none;
+                    while (!heap.empty()) {
+                        Var var = heap_pop();
+                        if (values[var] == Undef) {
+                            next = var;
+                            break;
+                        }
+                    }
+                    if (next == none) {
+                        model_values.assign(values.begin(), values.end());
+                        backtrack(0);
+                        return true;
+                    }
+                    decisions++;
+                    trail_limits.push_back(trail.size());
+                    assign(make_lit(next, phases[next]), none);
+                }
+            }
+        }
+
+        bool solve() {
+            return *solve(nullptr);
+        }
+
+        // The satisfying assignment found by the last successful `solve`
+        bool model(Var var) const {
+            return model_values[var];
+        }
+    };
+
+    // The clauses of `~(formulas[0] v formulas[1] v ...)`, with one solver
+    // variable for each atom and each distinct binary or n-ary subformula. Negations
+    // need no variable of their own: they are the negated literal of their
+    // operand.
+    struct Encoding {
+        // The variable behind each atom, in order of first appearance
+        std::vector<Token> atoms;
+        std::vector<Var> atom_vars;
+    };
+
+    Encoding encode_negation(Solver& solver, const FormulaFactory& factory, const std::vector<Formula*>& formulas) {
+        Encoding encoding;
+        constexpr Lit none = static_cast<Lit>(-1);
+        std::vector<Lit> lits(factory.size(), none);
+
+        std::vector<std::pair<Formula*, bool>> stack;
+        for (auto root : formulas) {
+            stack.push_back({root, false});
+            while (!stack.empty()) {
+                auto [formula, expanded] = stack.back();
+                stack.pop_back();
+                if (lits[formula->id] != none)
+                    continue;
+                switch (formula->type) {
+                    case FormulaType::Atom: {
+                        Var var = solver.new_var();
+                        encoding.atoms.push_back(formula->token);
+                        encoding.atom_vars.push_back(var);
+                        lits[formula->id] = make_lit(var);
+                        break;
+                    }
+                    case FormulaType::Unary: {
+                        auto op = (UnaryFormula*)formula;
+                        if (!expanded) {
+                            stack.push_back({formula, true});
+                            stack.push_back({op->right, false});
+                            break;
+                        }
+                        lits[formula->id] = negation(lits[op->right->id]);
+                        break;
+                    }
+                    case FormulaType::Binary: {
+                        auto op = (BinaryFormula*)formula;
+                        if (!expanded) {
+                            stack.push_back({formula, true});
+                            stack.push_back({op->right, false});
+                            stack.push_back({op->left, false});
+                            break;
+                        }
+                        Lit x = make_lit(solver.new_var());
+                        Lit a = lits[op->left->id];
+                        Lit b = lits[op->right->id];
+                        // `x <-> a op b`, with IMPLIES as `~a v b`
+                        if (op->token == Token::And) {
+                            solver.add_clause({negation(x), a});
+                            solver.add_clause({negation(x), b});
+                            solver.add_clause({x, negation(a), negation(b)});
+                        } else {
+                            if (op->token == Token::Implies)
+                                a = negation(a);
+                            solver.add_clause({x, negation(a)});
+                            solver.add_clause({x, negation(b)});
+                            solver.add_clause({negation(x), a, b});
+                        }
+                        lits[formula->id] = x;
+                        break;
+                    }
+                    case FormulaType::Nary: {
+                        auto op = (NaryFormula*)formula;
+                        if (!expanded) {
+                            stack.push_back({formula, true});
+                            for (unsigned i = op->arity; i-- > 0;)
+                                stack.push_back({op->operands[i], false});
+                            break;
+                        }
+                        Lit x = make_lit(solver.new_var());
+                        // `x <-> a_1 op a_2 op ...`, one binary clause per
+                        // operand and one long clause
+                        bool is_and = op->token == Token::And;
+                        std::vector<Lit> clause{is_and ? x : negation(x)};
+                        for (auto operand : *op) {
+                            Lit a = lits[operand->id];
+                            if (is_and)
+                                solver.add_clause({negation(x), a});
+                            else
+                                solver.add_clause({x, negation(a)});
+                            clause.push_back(is_and ? negation(a) : a);
+                        }
+                        solver.add_clause(clause);
+                        lits[formula->id] = x;
+                        break;
+                    }
+                }
+            }
+            // The disjunction is false only if every formula is
+            solver.add_clause({negation(lits[root->id])});
+        }
+        return encoding;
+    }
+}
+
+#endif
@@ -1,21 +1,21 @@
 #ifndef TOKENIZER_TOKEN_CPP
 #define TOKENIZER_TOKEN_CPP
 
-#include <map>
-#include <vector>
+#include <algorithm>
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace Tokenizer {
 
+    // A symbol, or a variable numbered by the symbol table that read it.
+    // Tokens are plain values: what a variable is called is only known to
+    // its table.
     class Token {
         unsigned val;
 
-    public:
-        static std::vector<Token> symbols;
-
-    private:
-        static std::map<std::string, Token> name_token_map;
-        static std::vector<std::string> token_names;
+        static constexpr unsigned variables_start = 6;
 
     public:
         static const Token LParen;
@@ -25,41 +25,17 @@ namespace Tokenizer {
         static const Token Implies;
         static const Token RParen;
 
-    private:
-        static const unsigned variables_start;
-        static unsigned next_value;
+        constexpr Token(unsigned val) : val(val) {}
 
-    public:
-        static int num_variables() {
-            return next_value - variables_start;
+        // The variable numbered `id` by its symbol table
+        static constexpr Token Variable(unsigned id) {
+            return Token(variables_start + id);
         }
 
         int id() const {
             return val - variables_start;
         }
 
-        static Token Variable(std::string name) {
-            auto search = name_token_map.find(name);
-            if (search != name_token_map.end())
-                return search->second;
-            return Token(name);
-        }
-
-        Token(unsigned val) : val(val) {}
-
-        Token(std::string name, bool is_symbol) {
-            val = next_value;
-            if (is_symbol)
-                symbols.push_back(*this);
-            else
-                name_token_map.insert({name, Token(val)});
-
-            token_names.push_back(name);
-            next_value++;
-        }
-
-        Token(std::string name) : Token(name, false) {}
-
         bool operator==(const Token &token) const {
             return this->val == token.val;
         }
@@ -68,8 +44,10 @@ namespace Tokenizer {
             return val;
         }
 
-        const std::string name() const {
-            return *const_cast<const std::string*>(&token_names[val]);
+        // How a symbol is written
+        std::string_view symbol_name() const {
+            static constexpr std::string_view names[] = {"(", "~", "^", "v", "->", ")"};
+            return names[val];
         }
 
         bool is_variable() const {
@@ -84,18 +62,99 @@ namespace Tokenizer {
             return variables_start - val;
         }
     };
-    std::vector<Token> Token::symbols;
-    std::map<std::string, Token> Token::name_token_map;
-    std::vector<std::string> Token::token_names;
-    unsigned Token::next_value = 0;
-    const Token Token::LParen  = Token("(",true);
-    const Token Token::Not     = Token("~",true);
-    const Token Token::And     = Token("^",true);
-    const Token Token::Or      = Token("v",true);
-    const Token Token::Implies = Token("->",true);
-    const Token Token::RParen  = Token(")",true);
-    const unsigned Token::variables_start = Token::next_value;
+    constexpr Token Token::LParen  = Token(0);
+    constexpr Token Token::Not     = Token(1);
+    constexpr Token Token::And     = Token(2);
+    constexpr Token Token::Or      = Token(3);
+    constexpr Token Token::Implies = Token(4);
+    constexpr Token Token::RParen  = Token(5);
+
+    // The names of the variables of one check, numbered densely from 0 in
+    // the order they are first seen. Names are kept back to back in one
+    // buffer and found through an open addressing table of variable ids,
+    // sized to a power of two. `clear` forgets every name but keeps the
+    // memory, so that a table can be reused check after check with ids
+    // that only ever cover the current one.
+    class SymbolTable {
+        static constexpr std::uint32_t empty = UINT32_MAX;
+
+        std::string buffer;
+        // Variable `i` is named by buffer[offsets[i], offsets[i+1])
+        std::vector<std::uint32_t> offsets = {0};
+        std::vector<std::uint64_t> hashes;
+        std::vector<std::uint32_t> slots = std::vector<std::uint32_t>(1 << 6, empty);
+
+        // FNV-1a
+        static std::uint64_t hash(std::string_view name) {
+            std::uint64_t h = 0xcbf29ce484222325ull;
+            for (char c : name)
+                h = (h ^ (unsigned char)c) * 0x100000001b3ull;
+            return h;
+        }
+
+        std::string_view variable_name(std::uint32_t id) const {
+            return std::string_view(buffer).substr(offsets[id], offsets[id + 1] - offsets[id]);
+        }
+
+        void grow() {
+            slots.assign(slots.size() << 1, empty);
+            std::size_t mask = slots.size() - 1;
+            for (std::uint32_t id = 0; id < hashes.size(); id++) {
+                std::size_t slot = hashes[id] & mask;
+                while (slots[slot] != empty)
+                    slot = (slot + 1) & mask;
+                slots[slot] = id;
+            }
+        }
+
+    public:
+        // The variable called `name`, numbered next if it is new
+        Token variable(std::string_view name) {
+            std::uint64_t h = hash(name);
+            std::size_t mask = slots.size() - 1;
+            std::size_t slot = h & mask;
+            while (slots[slot] != empty) {
+                std::uint32_t id = slots[slot];
+                if (hashes[id] == h and variable_name(id) == name)
+                    return Token::Variable(id);
+                slot = (slot + 1) & mask;
+            }
+            std::uint32_t id = hashes.size();
+            buffer.append(name);
+            offsets.push_back(buffer.size());
+            hashes.push_back(h);
+            slots[slot] = id;
+            if (2 * hashes.size() > slots.size())
+                grow();
+            return Token::Variable(id);
+        }
+
+        // How a token is written, for variables of this table and for
+        // symbols alike
+        std::string_view name(Token token) const {
+            if (token.is_symbol())
+                return token.symbol_name();
+            return variable_name(token.id());
+        }
+
+        unsigned num_variables() const {
+            return hashes.size();
+        }
+
+        // Forgets every variable, keeping the memory for the next check
+        void clear() {
+            buffer.clear();
+            offsets.assign(1, 0);
+            hashes.clear();
+            std::fill(slots.begin(), slots.end(), empty);
+        }
+
+        // Bytes held, including those kept for reuse after `clear`
+        std::size_t bytes() const {
+            return buffer.capacity() + offsets.capacity() * sizeof(std::uint32_t)
+                 + hashes.capacity() * sizeof(std::uint64_t) + slots.capacity() * sizeof(std::uint32_t);
+        }
+    };
 };
 
 #endif
-
@@ -0,0 +1,81 @@
+#include "tokenizer.cpp"
+#include "timer.hpp"
+
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+// Measures how fast formulas are tokenized, on inputs of a few kilobytes
+// up to several megabytes, both with few distinct variables and with a new
+// variable every few tokens.
+//
+// Build with `make bench-tokenizer` and run `./tokenizer-bench`.
+
+namespace {
+    volatile std::size_t sink;
+
+    // Name of the `i`th variable, made of letters only, and never starting
+    // with `v`, which would be read as OR
+    std::string variable(std::size_t i) {
+        std::string name(1, 'a' + i % 21);
+        for (i /= 21; i > 0; i /= 26)
+            name += (char)('a' + i % 26);
+        return name;
+    }
+
+    // A formula of about `bytes` characters over `variables` variables,
+    // using every connective
+    std::string formula(std::size_t bytes, std::size_t variables) {
+        static const char* const connectives[] = {" v ", " ^ ", " -> ", " v ~"};
+        std::string s = "(";
+        std::uint64_t state = 1;
+        for (std::size_t i = 0; s.size() < bytes; i++) {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            if (i > 0)
+                s += connectives[(state >> 33) % 4];
+            if (i % 8 == 7)
+                s += ") ^ (";
+            s += variable((state >> 40) % variables);
+        }
+        return s + ")";
+    }
+
+    // Repeats `op` until roughly `budget` seconds have passed, and returns
+    // the number of megabytes of input it handled per second
+    template<typename Op>
+    double throughput(std::size_t bytes_per_op, Op op, double budget = 0.2) {
+        std::size_t reps = 1;
+        while (true) {
+            timer t;
+            for (std::size_t r = 0; r < reps; r++)
+                op();
+            double time = t.get_time();
+            if (time >= budget)
+                return (double)bytes_per_op * reps / time / 1e6;
+            reps *= 2;
+        }
+    }
+}
+
+int main() {
+    std::cout << "Tokenizer throughput in MB/s of input" << std::endl;
+    std::cout << std::right << std::setw(12) << "bytes" << std::setw(12) << "variables"
+              << std::setw(12) << "tokens" << std::setw(12) << "MB/s" << std::endl;
+    for (std::size_t bytes : {1ul << 12, 1ul << 16, 1ul << 20, 1ul << 22}) {
+        for (std::size_t variables : {26ul, bytes / 16}) {
+            std::string input = formula(bytes, variables);
+            Tokenizer::SymbolTable symbols;
+            std::size_t tokens = Tokenizer::tokenize(input, symbols).size();
+            // Each run reads the input as a new check would, from an
+            // empty table
+            double rate = throughput(input.size(), [&]() {
+                symbols.clear();
+                sink = Tokenizer::tokenize(input, symbols).size();
+            });
+            std::cout << std::setw(12) << input.size() << std::setw(12) << variables
+                      << std::setw(12) << tokens
+                      << std::fixed << std::setprecision(2) << std::setw(12) << rate << std::endl;
+        }
+    }
+}
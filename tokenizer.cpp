@@ -4,6 +4,7 @@
 #include <cctype>
 #include <exception>
 #include <string>
+#include <string_view>
 #include <sstream>
 #include <iostream>
 
@@ -14,7 +15,7 @@ namespace Tokenizer {
     struct UnknownCharacterException : public std::exception {
         std::string message;
 
-        UnknownCharacterException(std::string bad_string, int idx) {
+        UnknownCharacterException(std::string_view bad_string, std::size_t idx) {
 
             std::ostringstream buf;
             buf << "Unknown character '" << bad_string[idx] << "' at index " << idx << " of \"" << bad_string << "\".";
@@ -26,56 +27,91 @@ namespace Tokenizer {
         }
     };
 
-    std::string to_string(std::vector<Tokenizer::Token> tokens) {
+    std::string to_string(const SymbolTable& symbols, std::vector<Tokenizer::Token> tokens) {
         std::stringstream ss;
         ss << '[';
         if (tokens.size() > 0) {
-            ss << tokens[0].name();
-            for (int i = 1; i < tokens.size(); i++)
-                ss << ", " << tokens[i].name();
+            ss << symbols.name(tokens[0]);
+            for (std::size_t i = 1; i < tokens.size(); i++)
+                ss << ", " << symbols.name(tokens[i]);
         }
         ss << ']';
         return ss.str();
     }
 
-    namespace {
-        bool matches_substr(std::string s, int i, std::string substr) {
-            for (int j = 0; i+j < s.length() and j < substr.length(); j++)
-                if (s[i+j] != substr[j])
-                    return false;
-            return true;
-        }
-    }
+    // Reads tokens off `s` one at a time, picking each one from its first
+    // character, with variables numbered by `symbols`. A `v` that starts a
+    // token is always OR, so variable names cannot start with one.
+    class Scanner {
+        std::string_view s;
+        SymbolTable& symbols;
+        std::size_t i = 0;
 
-    std::vector<Token> tokenize(std::string s) {
-        std::vector<Token> tokens;
-        for (int i=0; i < s.length(); i++) {
-            // Ignore horizontal whitespace
-            if (s[i] == ' ' or s[i] == '\t')
-                continue;
-            // Check if the next part of the string is a symbol
-            for (auto symbol : Token::symbols) {
-                if (matches_substr(s, i, symbol.name())) {
-                    i += symbol.name().length() - 1;
-                    tokens.push_back(symbol);
-                    goto nextiter;
+    public:
+        Scanner(std::string_view s, SymbolTable& symbols) : s(s), symbols(symbols) {}
+
+        // Stores the next token in `token`, or returns false at the end of
+        // the input
+        bool next(Token& token) {
+            while (i < s.length()) {
+                switch (s[i]) {
+                    // Ignore horizontal whitespace
+                    case ' ':
+                    case '\t':
+                        i++;
+                        continue;
+                    case '(':
+                        token = Token::LParen;
+                        i++;
+                        return true;
+                    case ')':
+                        token = Token::RParen;
+                        i++;
+                        return true;
+                    case '~':
+                        token = Token::Not;
+                        i++;
+                        return true;
+                    case '^':
+                        token = Token::And;
+                        i++;
+                        return true;
+                    case 'v':
+                        token = Token::Or;
+                        i++;
+                        return true;
+                    case '-':
+                        if (i + 1 < s.length() and s[i+1] == '>') {
+                            token = Token::Implies;
+                            i += 2;
+                            return true;
+                        }
+                        break;
                 }
+                // Check if the next part of the string is a variable
+                if (isalpha((unsigned char)s[i])) {
+                    std::size_t j;
+                    for (j = i+1; j < s.length() and isalpha((unsigned char)s[j]); j++);
+                    token = symbols.variable(s.substr(i, j-i));
+                    i = j;
+                    return true;
+                }
+                // If we reach here, s[i] is an invalid character
+                throw UnknownCharacterException(s,i);
             }
-            // Check if the next part of the string is a variable
-            if (isalpha(s[i])) {
-                int j;
-                for (j = i+1; j < s.length() and isalpha(s[j]); j++);
-                tokens.push_back(Token::Variable(s.substr(i, j-i)));
-                i = j - 1;
-                continue;
-            }
-            // If we reach here, s[i] is an invalid character   
-            throw UnknownCharacterException(s,i);
-            nextiter:; 
+            return false;
         }
+    };
+
+    // Splits `s` into tokens in a single pass
+    std::vector<Token> tokenize(std::string_view s, SymbolTable& symbols) {
+        std::vector<Token> tokens;
+        Scanner scanner(s, symbols);
+        Token token = Token::LParen;
+        while (scanner.next(token))
+            tokens.push_back(token);
         return tokens;
     }
-
 }
 
 #endif
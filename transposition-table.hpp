@@ -0,0 +1,182 @@
+#ifndef TRANSPOSITION_TABLE_HPP
+#define TRANSPOSITION_TABLE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Set of keys, each a sequence of unsigned integers with a precomputed hash,
+// held within a memory budget. Once the budget is used up, entries are
+// evicted with the clock algorithm: a hand sweeps over the entries, sparing
+// those looked up since it last passed them, and evicts the first one that
+// was not. A budget of 0 disables the table.
+class transposition_table {
+    struct entry {
+        std::uint64_t hash;
+        std::vector<unsigned> key;
+        bool referenced;
+        bool live;
+    };
+
+    static constexpr std::uint32_t empty = UINT32_MAX;
+
+    std::size_t budget;
+    std::size_t used = 0;
+    std::vector<entry> entries;
+    // Entries that were evicted and can be reused
+    std::vector<std::uint32_t> free;
+    // Open addressing index of the live entries, sized to a power of two
+    std::vector<std::uint32_t> slots;
+    std::size_t num_live = 0;
+    std::size_t hand = 0;
+
+    std::size_t num_hits = 0;
+    std::size_t num_evictions = 0;
+
+    static std::size_t cost(std::size_t length) {
+        return sizeof(entry) + length * sizeof(unsigned) + 2 * sizeof(std::uint32_t);
+    }
+
+    bool matches(std::uint32_t index, std::uint64_t hash, std::span<const unsigned> key) const {
+        const entry& e = entries[index];
+        return e.hash == hash and e.key.size() == key.size() and std::equal(key.begin(), key.end(), e.key.begin());
+    }
+
+    std::uint32_t find(std::uint64_t hash, std::span<const unsigned> key) const {
+        if (num_live == 0)
+            return empty;
+        std::size_t mask = slots.size() - 1;
+        for (std::size_t slot = hash & mask; slots[slot] != empty; slot = (slot + 1) & mask)
+            if (matches(slots[slot], hash, key))
+                return slots[slot];
+        return empty;
+    }
+
+    void link(std::uint32_t index) {
+        std::size_t mask = slots.size() - 1;
+        std::size_t slot = entries[index].hash & mask;
+        while (slots[slot] != empty)
+            slot = (slot + 1) & mask;
+        slots[slot] = index;
+    }
+
+    // Removes an entry from the index, shifting back the entries after it
+    // that could not be placed in their own slot
+    void unlink(std::uint32_t index) {
+        std::size_t mask = slots.size() - 1;
+        std::size_t slot = entries[index].hash & mask;
+        while (slots[slot] != index)
+            slot = (slot + 1) & mask;
+        slots[slot] = empty;
+        for (std::size_t next = (slot + 1) & mask; slots[next] != empty; next = (next + 1) & mask) {
+            std::size_t home = entries[slots[next]].hash & mask;
+            if (((next - home) & mask) >= ((next - slot) & mask)) {
+                slots[slot] = slots[next];
+                slots[next] = empty;
+                slot = next;
+            }
+        }
+    }
+
+    void grow() {
+        slots.assign(slots.empty() ? 1 << 10 : slots.size() << 1, empty);
+        for (std::uint32_t index = 0; index < entries.size(); index++)
+            if (entries[index].live)
+                link(index);
+    }
+
+    void evict() {
+        while (true) {
+            if (hand >= entries.size())
+                hand = 0;
+            entry& e = entries[hand];
+            if (e.live and e.referenced) {
+                e.referenced = false;
+            } else if (e.live) {
+                unlink(hand);
+                used -= cost(e.key.size());
+                e.live = false;
+                std::vector<unsigned>().swap(e.key);
+                free.push_back(hand);
+                num_live--;
+                num_evictions++;
+                hand++;
+                return;
+            }
+            hand++;
+        }
+    }
+
+public:
+    explicit transposition_table(std::size_t budget) : budget(budget) {}
+
+    bool enabled() const {
+        return budget != 0;
+    }
+
+    // Whether some key with this hash is in the table, so that `contains`
+    // can be skipped when building the key is costly
+    bool may_contain(std::uint64_t hash) const {
+        if (num_live == 0)
+            return false;
+        std::size_t mask = slots.size() - 1;
+        for (std::size_t slot = hash & mask; slots[slot] != empty; slot = (slot + 1) & mask)
+            if (entries[slots[slot]].hash == hash)
+                return true;
+        return false;
+    }
+
+    bool contains(std::uint64_t hash, std::span<const unsigned> key) {
+        std::uint32_t index = find(hash, key);
+        if (index == empty)
+            return false;
+        entries[index].referenced = true;
+        num_hits++;
+        return true;
+    }
+
+    // Adds `key`, unless it is already there or alone exceeds the budget
+    void insert(std::uint64_t hash, std::span<const unsigned> key) {
+        std::size_t needed = cost(key.size());
+        if (needed > budget or find(hash, key) != empty)
+            return;
+        while (used + needed > budget)
+            evict();
+
+        std::uint32_t index;
+        if (!free.empty()) {
+            index = free.back();
+            free.pop_back();
+        } else {
+            index = entries.size();
+            entries.emplace_back();
+        }
+        entries[index] = {hash, std::vector<unsigned>(key.begin(), key.end()), false, true};
+        used += needed;
+        num_live++;
+        if (2 * num_live > slots.size())
+            grow();
+        else
+            link(index);
+    }
+
+    std::size_t size() const {
+        return num_live;
+    }
+
+    std::size_t hits() const {
+        return num_hits;
+    }
+
+    std::size_t evictions() const {
+        return num_evictions;
+    }
+
+    std::size_t bytes() const {
+        return used;
+    }
+};
+
+#endif
@@ -0,0 +1,326 @@
+#ifndef TRUTH_TABLE_TRUTH_TABLE_CPP
+#define TRUTH_TABLE_TRUTH_TABLE_CPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "parser.cpp"
+#include "work-stealing-pool.hpp"
+
+// Decides tautologies by evaluating the formula under every assignment of
+// its variables. The formula is compiled to a flat program, which is run on
+// a whole block of assignments at a time: each bit of a block is one
+// assignment, so a single AND/OR/NOT instruction evaluates hundreds of
+// them at once.
+namespace TruthTable {
+    using Parser::Formula;
+    using Parser::UnaryFormula;
+    using Parser::BinaryFormula;
+    using Parser::NaryFormula;
+    using Parser::FormulaType;
+    using Parser::FormulaFactory;
+
+    using Tokenizer::Token;
+
+    // Assignments per block, as a power of two. The block is a GCC vector,
+    // so it is held in one AVX-512 or AVX2 register when those are enabled
+    // at compile time, and in a pair of SSE registers otherwise.
+#if defined(__AVX512F__)
+    constexpr unsigned block_words = 8;
+    constexpr unsigned block_bits = 9;
+#elif defined(__AVX2__)
+    constexpr unsigned block_words = 4;
+    constexpr unsigned block_bits = 8;
+#else
+    constexpr unsigned block_words = 2;
+    constexpr unsigned block_bits = 7;
+#endif
+    typedef std::uint64_t Block __attribute__((vector_size(block_words * sizeof(std::uint64_t))));
+
+    // Variables above this are not worth enumerating
+    constexpr unsigned max_variables = 40;
+    // Assignments are numbered by 64-bit integers, so formulas with more
+    // variables than this cannot be checked at all
+    constexpr unsigned max_enumerable_variables = 64;
+
+    enum Op : unsigned char {
+        Var,
+        Not,
+        And,
+        Or,
+        Implies
+    };
+
+    // Computes `a op b` into its own slot. For `Var`, `a` is the variable's
+    // index; for `Not`, only `a` is used.
+    struct Instruction {
+        Op op;
+        unsigned a;
+        unsigned b;
+    };
+
+    // Straight-line code for a set of formulas joined by `v`. Every distinct
+    // subformula is one instruction, emitted in postfix order so that
+    // operands always come first, and the last instruction is the result.
+    struct Program {
+        std::vector<Instruction> code;
+        // The variable behind each index, in order of first appearance
+        std::vector<Token> variables;
+    };
+
+    Program compile(const FormulaFactory& factory, const std::vector<Formula*>& formulas) {
+        Program program;
+        constexpr unsigned none = static_cast<unsigned>(-1);
+        std::vector<unsigned> slot(factory.size(), none);
+        std::vector<unsigned> variable(factory.num_variables(), none);
+
+        // Post-order walk: a formula is emitted the second time it is seen,
+        // once its operands have been
+        std::vector<std::pair<Formula*, bool>> stack;
+        unsigned result = none;
+        for (auto root : formulas) {
+            stack.push_back({root, false});
+            while (!stack.empty()) {
+                auto [formula, expanded] = stack.back();
+                stack.pop_back();
+                if (slot[formula->id] != none)
+                    continue;
+                switch (formula->type) {
+                    case FormulaType::Atom: {
+                        unsigned& var = variable[formula->token.id()];
+                        if (var == none) {
+                            var = program.variables.size();
+                            program.variables.push_back(formula->token);
+                        }
+                        slot[formula->id] = program.code.size();
+                        program.code.push_back({Op::Var, var, 0});
+                        break;
+                    }
+                    case FormulaType::Unary: {
+                        auto op = (UnaryFormula*)formula;
+                        if (!expanded) {
+                            stack.push_back({formula, true});
+                            stack.push_back({op->right, false});
+                            break;
+                        }
+                        slot[formula->id] = program.code.size();
+                        program.code.push_back({Op::Not, slot[op->right->id], 0});
+                        break;
+                    }
+                    case FormulaType::Binary: {
+                        auto op = (BinaryFormula*)formula;
+                        if (!expanded) {
+                            stack.push_back({formula, true});
+                            stack.push_back({op->right, false});
+                            stack.push_back({op->left, false});
+                            break;
+                        }
+                        Op code = op->token == Token::And ? Op::And : op->token == Token::Or ? Op::Or : Op::Implies;
+                        slot[formula->id] = program.code.size();
+                        program.code.push_back({code, slot[op->left->id], slot[op->right->id]});
+                        break;
+                    }
+                    case FormulaType::Nary: {
+                        auto op = (NaryFormula*)formula;
+                        if (!expanded) {
+                            stack.push_back({formula, true});
+                            for (unsigned i = op->arity; i-- > 0;)
+                                stack.push_back({op->operands[i], false});
+                            break;
+                        }
+                        // A chain of binary instructions, the last of which
+                        // is the formula's slot
+                        Op code = op->token == Token::And ? Op::And : Op::Or;
+                        unsigned acc = slot[op->operands[0]->id];
+                        for (unsigned i = 1; i < op->arity; i++) {
+                            program.code.push_back({code, acc, slot[op->operands[i]->id]});
+                            acc = program.code.size() - 1;
+                        }
+                        slot[formula->id] = acc;
+                        break;
+                    }
+                }
+            }
+            // Join the formulas by `v`
+            if (result == none) {
+                result = slot[root->id];
+            } else {
+                program.code.push_back({Op::Or, result, slot[root->id]});
+                result = program.code.size() - 1;
+            }
+        }
+        // Make sure the result is the last instruction
+        if (result != none and result != program.code.size() - 1)
+            program.code.push_back({Op::Or, result, result});
+        return program;
+    }
+
+    struct Result {
+        bool is_tautology;
+        // A falsifying assignment, by variable index, when there is one
+        std::vector<bool> counterexample;
+        std::uint64_t assignments;
+        // Whether `stop` ended the check before it was decided, in which
+        // case `is_tautology` means nothing
+        bool stopped = false;
+    };
+
+    namespace {
+        // Evaluates blocks of assignments with one set of instruction slots
+        class Evaluator {
+            const Program& program;
+            std::vector<Block> slots;
+            // Values of the variables whose bit changes within a block
+            Block patterns[block_bits];
+
+        public:
+            Evaluator(const Program& program) : program(program), slots(program.code.size()) {
+                for (unsigned var = 0; var < block_bits; var++) {
+                    for (unsigned word = 0; word < block_words; word++) {
+                        std::uint64_t value = 0;
+                        for (unsigned bit = 0; bit < 64; bit++)
+                            if ((((std::uint64_t)word << 6 | bit) >> var) & 1)
+                                value |= (std::uint64_t)1 << bit;
+                        patterns[var][word] = value;
+                    }
+                }
+            }
+
+            // Evaluates the program on assignments `index << block_bits` to
+            // `((index + 1) << block_bits) - 1`. Returns the position of a
+            // falsifying assignment within the block, or -1 if there is none.
+            int evaluate(std::uint64_t index) {
+                const Block ones = ~Block{};
+                const Block zeros = Block{};
+                for (std::size_t i = 0; i < program.code.size(); i++) {
+                    const Instruction& instr = program.code[i];
+                    switch (instr.op) {
+                        case Op::Var:
+                            if (instr.a < block_bits)
+                                slots[i] = patterns[instr.a];
+                            else
+                                slots[i] = ((index >> (instr.a - block_bits)) & 1) ? ones : zeros;
+                            break;
+                        case Op::Not:
+                            slots[i] = ~slots[instr.a];
+                            break;
+                        case Op::And:
+                            slots[i] = slots[instr.a] & slots[instr.b];
+                            break;
+                        case Op::Or:
+                            slots[i] = slots[instr.a] | slots[instr.b];
+                            break;
+                        case Op::Implies:
+                            slots[i] = ~slots[instr.a] | slots[instr.b];
+                            break;
+                    }
+                }
+                // Assignments past the last variable repeat earlier ones, so
+                // the whole block can be checked even for tiny formulas
+                const Block& result = slots.back();
+                for (unsigned word = 0; word < block_words; word++)
+                    if (~result[word] != 0)
+                        return word * 64 + __builtin_ctzll(~result[word]);
+                return -1;
+            }
+        };
+
+        struct Range {
+            std::uint64_t begin;
+            std::uint64_t end;
+        };
+
+        // Blocks evaluated between calls to `stop`
+        constexpr std::uint64_t stop_interval = 64;
+    }
+
+    // Runs `program` on every assignment of its variables, split into
+    // ranges of blocks across `threads` threads (0 for one per hardware
+    // thread). Stops at the first falsifying assignment found. Every so
+    // often `stop`, if given, is called with about how many assignments
+    // have been evaluated, and the check gives up if it returns true.
+    // Programs over more than `max_enumerable_variables` variables are
+    // rejected with an exception.
+    Result check(const Program& program, unsigned threads = 1, const std::function<bool(std::uint64_t)>& stop = nullptr) {
+        Result result{true, {}, 0};
+        unsigned n = program.variables.size();
+        if (n > max_enumerable_variables)
+            throw std::runtime_error("The truth table engine cannot enumerate " + std::to_string(n)
+                                     + " variables (at most " + std::to_string(max_enumerable_variables) + ")");
+        if (program.code.empty()) {
+            result.is_tautology = false;
+            return result;
+        }
+
+        std::uint64_t blocks = n <= block_bits ? 1 : (std::uint64_t)1 << (n - block_bits);
+        std::uint64_t block_size = (std::uint64_t)1 << std::min(n, block_bits);
+        std::mutex result_lock;
+        std::atomic<std::uint64_t> evaluated(0);
+        auto found = [&](std::uint64_t assignment) {
+            std::lock_guard<std::mutex> guard(result_lock);
+            if (!result.is_tautology)
+                return;
+            result.is_tautology = false;
+            result.counterexample.resize(n);
+            for (unsigned var = 0; var < n; var++)
+                result.counterexample[var] = (assignment >> var) & 1;
+        };
+
+        if (threads == 1 or blocks == 1) {
+            Evaluator evaluator(program);
+            std::uint64_t index;
+            for (index = 0; index < blocks; index++) {
+                if (stop and index % stop_interval == 0 and index > 0 and stop(index * block_size)) {
+                    result.stopped = true;
+                    break;
+                }
+                int pos = evaluator.evaluate(index);
+                if (pos >= 0) {
+                    found((index << block_bits) | pos);
+                    index++;
+                    break;
+                }
+            }
+            evaluated = index;
+        } else {
+            work_stealing_pool<Range> pool(threads);
+            std::vector<Evaluator> evaluators(pool.size(), Evaluator(program));
+            std::uint64_t chunk = std::max<std::uint64_t>(1, blocks / (64 * pool.size()));
+            std::vector<Range> ranges;
+            for (std::uint64_t begin = 0; begin < blocks; begin = ranges.back().end)
+                ranges.push_back({begin, blocks - begin > chunk ? begin + chunk : blocks});
+            std::atomic<bool> stopped(false);
+            pool.run(ranges, [&](unsigned id, Range& range) {
+                std::uint64_t index;
+                for (index = range.begin; index < range.end and !pool.cancelled(); index++) {
+                    if (stop and (index - range.begin) % stop_interval == 0 and stop((evaluated + index - range.begin) * block_size)) {
+                        stopped = true;
+                        pool.cancel();
+                        break;
+                    }
+                    int pos = evaluators[id].evaluate(index);
+                    if (pos >= 0) {
+                        found((index << block_bits) | pos);
+                        pool.cancel();
+                        index++;
+                        break;
+                    }
+                }
+                evaluated += index - range.begin;
+            });
+            // A falsifying assignment decides the check, even if another
+            // worker was told to stop at the same time
+            result.stopped = stopped and result.is_tautology;
+        }
+        result.assignments = evaluated * block_size;
+        return result;
+    }
+}
+
+#endif
@@ -0,0 +1,147 @@
+#ifndef WORK_STEALING_POOL_HPP
+#define WORK_STEALING_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs a tree of tasks on a fixed set of threads. Every thread owns a
+// deque: tasks it spawns go on the back and it takes its own work from the
+// back, so each thread explores depth first. Idle threads steal the oldest
+// task from the front of another thread's deque, which is usually the
+// biggest piece of work left there.
+template<typename Task>
+class work_stealing_pool {
+    struct worker {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    unsigned num_threads;
+    std::unique_ptr<worker[]> workers;
+    // Tasks that have been pushed but not yet finished
+    std::atomic<std::size_t> outstanding;
+    std::atomic<bool> stopped;
+    std::atomic<std::size_t> num_steals;
+
+    std::mutex error_lock;
+    std::exception_ptr error;
+
+    bool pop(unsigned id, Task& task) {
+        std::lock_guard<std::mutex> guard(workers[id].lock);
+        if (workers[id].tasks.empty())
+            return false;
+        task = std::move(workers[id].tasks.back());
+        workers[id].tasks.pop_back();
+        return true;
+    }
+
+    template<typename Adopt>
+    bool steal(unsigned id, Task& task, Adopt& adopt) {
+        for (unsigned i = 1; i < num_threads; i++) {
+            worker& victim = workers[(id + i) % num_threads];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (victim.tasks.empty())
+                continue;
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            adopt(id, task);
+            num_steals++;
+            return true;
+        }
+        return false;
+    }
+
+    template<typename Work, typename Adopt>
+    void work_loop(unsigned id, Work& work, Adopt& adopt) {
+        Task task;
+        while (!stopped) {
+            if (!pop(id, task) and !steal(id, task, adopt)) {
+                if (outstanding == 0)
+                    break;
+                std::this_thread::yield();
+                continue;
+            }
+            try {
+                work(id, task);
+            } catch (...) {
+                std::lock_guard<std::mutex> guard(error_lock);
+                if (!error)
+                    error = std::current_exception();
+                stopped = true;
+            }
+            outstanding--;
+        }
+    }
+
+public:
+    // Uses one thread per hardware thread when `threads` is 0
+    explicit work_stealing_pool(unsigned threads = 0)
+        : num_threads(threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency())),
+          workers(new worker[num_threads]), outstanding(0), stopped(false), num_steals(0) {}
+
+    unsigned size() const {
+        return num_threads;
+    }
+
+    // Adds a task to the deque of worker `id`. Only worker `id` itself may
+    // call this while the pool is running.
+    void push(unsigned id, Task task) {
+        outstanding++;
+        std::lock_guard<std::mutex> guard(workers[id].lock);
+        workers[id].tasks.push_back(std::move(task));
+    }
+
+    // Makes every worker stop at its next task boundary
+    void cancel() {
+        stopped = true;
+    }
+
+    bool cancelled() const {
+        return stopped;
+    }
+
+    std::size_t steals() const {
+        return num_steals;
+    }
+
+    // Runs `roots`, and every task they push, until none are left or the
+    // pool is cancelled. `work(id, task)` runs one task on worker `id`.
+    // `adopt(id, task)` is called by worker `id` on a task it has just
+    // stolen, while the victim's deque is still locked, to take copies of
+    // anything the victim may free once it moves on. The first exception
+    // thrown by `work` cancels the pool and is rethrown here.
+    template<typename Work, typename Adopt>
+    void run(std::vector<Task> roots, Work work, Adopt adopt) {
+        stopped = false;
+        error = nullptr;
+        for (std::size_t i = 0; i < roots.size(); i++)
+            push(i % num_threads, std::move(roots[i]));
+
+        std::vector<std::thread> threads;
+        for (unsigned id = 1; id < num_threads; id++)
+            threads.emplace_back([&, id]() { work_loop(id, work, adopt); });
+        work_loop(0, work, adopt);
+        for (auto& thread : threads)
+            thread.join();
+
+        // Drop anything left behind by a cancelled run
+        for (unsigned id = 0; id < num_threads; id++)
+            workers[id].tasks.clear();
+        outstanding = 0;
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    template<typename Work>
+    void run(std::vector<Task> roots, Work work) {
+        run(std::move(roots), work, [](unsigned, Task&) {});
+    }
+};
+
+#endif